@@ -0,0 +1,193 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QTest>
+
+#include "blurpainttracker.h"
+#include "blurrectlist.h"
+#include "blurshape.h"
+#include "blurspatialindex.h"
+
+#include <atomic>
+#include <cstdlib>
+
+// glibc lets the executable interpose the allocator, operator new and QArrayData end up here too
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+}
+
+static std::atomic<bool> s_counting = false;
+static std::atomic<int> s_allocations = 0;
+
+extern "C" void *malloc(size_t size)
+{
+    if (s_counting) {
+        ++s_allocations;
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    if (s_counting) {
+        ++s_allocations;
+    }
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    if (s_counting) {
+        ++s_allocations;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+using namespace KWin;
+
+/**
+ * The structures prePaintWindow() and blur() fill for every window in every frame must
+ * not allocate once they have grown to the size of a frame.
+ */
+class AllocationTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testRectListSteadyState();
+    void testSpatialIndexSteadyState();
+    void testFrameSteadyState();
+
+private:
+    template<typename Func>
+    int countAllocations(Func func);
+};
+
+template<typename Func>
+int AllocationTest::countAllocations(Func func)
+{
+    // The first frames grow the storage
+    func();
+    func();
+
+    s_allocations = 0;
+    s_counting = true;
+    for (int i = 0; i < 10; ++i) {
+        func();
+    }
+    s_counting = false;
+    return s_allocations;
+}
+
+void AllocationTest::testRectListSteadyState()
+{
+    const QRegion background(0, 0, 1920, 1080);
+    const QRegion panel(0, 1040, 1920, 40);
+    QRegion window(200, 100, 800, 600);
+    window += QRect(300, 700, 400, 100);
+    const QRegion opaque(210, 110, 780, 580);
+
+    BlurNGRectList painted;
+    const int allocations = countAllocations([&]() {
+        painted.clear();
+        painted.add(background);
+        painted.subtract(opaque);
+        painted.add(window);
+        painted.subtract(panel);
+        painted.add(panel);
+        QVERIFY(painted.intersects(QRect(1000, 500, 100, 100)));
+    });
+    QCOMPARE(allocations, 0);
+}
+
+void AllocationTest::testSpatialIndexSteadyState()
+{
+    std::vector<QRect> bounds;
+    for (int i = 0; i < 16; ++i) {
+        bounds.push_back(QRect(i * 100, (i % 4) * 250, 300, 200));
+    }
+    std::vector<QRegion> visibleAreas(bounds.size());
+    const QRegion paint(0, 900, 1920, 180);
+    const QRegion opaque(0, 880, 1920, 200);
+
+    BlurNGSpatialIndex index;
+    const int allocations = countAllocations([&]() {
+        index.clear();
+        for (size_t i = 0; i < bounds.size(); ++i) {
+            index.insert(bounds[i], &visibleAreas[i]);
+        }
+        QVERIFY(index.intersects(QRect(150, 50, 10, 10)));
+        QVERIFY(!index.intersects(QRect(0, 1000, 1920, 80)));
+        QVERIFY(!index.intersectsUncovered(paint, opaque));
+    });
+    QCOMPARE(allocations, 0);
+}
+
+void AllocationTest::testFrameSteadyState()
+{
+    // A clock on the wallpaper ticks below a blurred panel, a terminal covers part of the panel
+    const QRegion empty;
+    const QRegion screen(0, 0, 1920, 1080);
+    const QRegion clock(1700, 1000, 100, 50);
+    const QRect panelArea(0, 980, 1920, 100);
+    const QRegion panelShape(0, 0, 1920, 100);
+    const QRegion terminal(100, 500, 800, 600);
+
+    BlurNGPaintTracker tracker;
+    tracker.setExpandSize(20);
+    BlurNGPaintTracker::WindowCache wallpaperCache;
+    BlurNGPaintTracker::WindowCache panelCache;
+    BlurNGPaintTracker::WindowCache terminalCache;
+    QRegion visibleArea;
+    QList<QRectF> effectiveShape;
+
+    const int allocations = countAllocations([&]() {
+        // KWin hands out the same regions for every window in a steady frame
+        tracker.clear();
+
+        QRegion paint = clock;
+        QRegion opaque = screen;
+        QVERIFY(!tracker.addWindow(paint, opaque, wallpaperCache, nullptr));
+
+        QRegion panelPaint = empty;
+        opaque = empty;
+        const BlurNGPaintTracker::BlurredWindow panel{
+            .area = panelArea,
+            .cached = true,
+            .visibleArea = &visibleArea,
+        };
+        QVERIFY(tracker.addWindow(panelPaint, opaque, panelCache, &panel));
+        QVERIFY(panelPaint.intersects(clock.boundingRect()));
+
+        paint = empty;
+        opaque = terminal;
+        QVERIFY(!tracker.addWindow(paint, opaque, terminalCache, nullptr));
+        QVERIFY(opaque != terminal);
+
+        tracker.updateVisibleAreas();
+        QVERIFY(visibleArea.rectCount() > 1);
+
+        // blur() of the panel
+        effectiveShape.clear();
+        const BlurNGShapeClip clip{
+            .paintRegion = panelPaint,
+            .visibleArea = visibleArea,
+            .clipToVisible = true,
+            .shapeToBackground = QPoint(),
+            .deviceBackgroundRect = panelArea,
+            .scale = 1.0,
+        };
+        appendBlurShape(effectiveShape, clip, std::span(panelShape.begin(), panelShape.end()));
+        QVERIFY(!effectiveShape.isEmpty());
+    });
+    QCOMPARE(allocations, 0);
+}
+
+QTEST_GUILESS_MAIN(AllocationTest)
+
+#include "allocationtest.moc"
@@ -0,0 +1,94 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QTest>
+
+#include "kawasemodel.h"
+
+using namespace KawaseModel;
+
+/**
+ * Measures the banding that GL_R11F_G11F_B10F adds to the intermediate levels of the
+ * blur chain compared to GL_RGBA16F.
+ */
+class BandingTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testPackedChain_data();
+    void testPackedChain();
+};
+
+// The 8 bit code an SDR value ends up with
+static float srgbCode(float linear)
+{
+    linear = std::clamp(linear, 0.0f, 1.0f);
+    const float encoded = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1 / 2.4f) - 0.055f;
+    return encoded * 255;
+}
+
+void BandingTest::testPackedChain_data()
+{
+    QTest::addColumn<int>("iterations");
+    QTest::addColumn<float>("offset");
+    QTest::addColumn<int>("mantissa");
+    QTest::addColumn<float>("from");
+    QTest::addColumn<float>("to");
+
+    // The largest offset of every iteration count, see BlurNGEffect::initBlurNGStrengthValues()
+    const std::pair<int, float> strengths[] = {{1, 2.0f}, {2, 3.0f}, {3, 5.0f}, {4, 8.0f}};
+    // R11F and G11F keep 6 bits of mantissa, B10F 5
+    const std::pair<const char *, int> channels[] = {{"rg", 6}, {"b", 5}};
+    const std::pair<float, float> gradients[] = {{0.0f, 1.0f}, {0.0f, 0.05f}, {0.2f, 0.3f}, {0.9f, 1.0f}};
+
+    for (const auto &[iterations, offset] : strengths) {
+        for (const auto &[channel, mantissa] : channels) {
+            for (const auto &[from, to] : gradients) {
+                QTest::addRow("%d iterations, %s, %.2f-%.2f", iterations, channel, from, to) << iterations << offset << mantissa << from << to;
+            }
+        }
+    }
+}
+
+void BandingTest::testPackedChain()
+{
+    QFETCH(int, iterations);
+    QFETCH(float, offset);
+    QFETCH(int, mantissa);
+    QFETCH(float, from);
+    QFETCH(float, to);
+
+    // The first level keeps the format of the FP16 render target
+    const int width = 1024;
+    Level background(width);
+    for (int i = 0; i < width; ++i) {
+        background[i] = quantize(from + (to - from) * i / (width - 1), s_halfMantissa);
+    }
+
+    const Level reference = blur(background, iterations, offset, s_halfMantissa);
+    const Level packed = blur(background, iterations, offset, mantissa);
+
+    // Banding shows as steps between neighbouring pixels that the smooth gradient
+    // doesn't have. A step of a whole code turns into a visible edge.
+    float banding = 0;
+    float error = 0;
+    for (int i = 0; i < width; ++i) {
+        error = std::max(error, std::abs(srgbCode(packed[i]) - srgbCode(reference[i])));
+        if (i > 0) {
+            const float packedStep = srgbCode(packed[i]) - srgbCode(packed[i - 1]);
+            const float referenceStep = srgbCode(reference[i]) - srgbCode(reference[i - 1]);
+            banding = std::max(banding, std::abs(packedStep - referenceStep));
+        }
+    }
+
+    qDebug("banding %.3f codes, error %.3f codes", banding, error);
+    QVERIFY(banding < 1.0f);
+}
+
+QTEST_GUILESS_MAIN(BandingTest)
+
+#include "bandingtest.moc"
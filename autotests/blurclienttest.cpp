@@ -0,0 +1,197 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QGuiApplication>
+#include <QTest>
+
+#include "blurclient.h"
+
+#include <wayland-server-core.h>
+
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <thread>
+
+/**
+ * A compositor that only counts the requests the masks send. It offers what
+ * the Qt platform plugin needs to connect and what the blur client binds.
+ */
+class TestCompositor
+{
+public:
+    TestCompositor()
+    {
+        m_display = wl_display_create();
+        m_socket = wl_display_add_socket_auto(m_display);
+        wl_display_init_shm(m_display);
+        wl_display_add_shm_format(m_display, WL_SHM_FORMAT_R8);
+        wl_global_create(m_display, &wl_compositor_interface, 1, this, bindCompositor);
+        wl_global_create(m_display, &mbition_blur_manager_v1_interface, 5, this, bindBlurManager);
+        m_thread = std::thread([this] {
+            wl_event_loop *loop = wl_display_get_event_loop(m_display);
+            while (!m_quit) {
+                wl_event_loop_dispatch(loop, 10);
+                wl_display_flush_clients(m_display);
+            }
+        });
+    }
+
+    ~TestCompositor()
+    {
+        m_quit = true;
+        m_thread.join();
+        wl_display_destroy_clients(m_display);
+        wl_display_destroy(m_display);
+    }
+
+    const char *socket() const
+    {
+        return m_socket;
+    }
+
+    /// How often the masks sent each request, by opcode
+    int maskRequests(uint32_t opcode) const
+    {
+        return m_maskRequests[opcode];
+    }
+
+private:
+    static void bindCompositor(wl_client *client, void *data, uint32_t version, uint32_t id)
+    {
+        createResource(client, &wl_compositor_interface, version, id, data);
+    }
+
+    static void bindBlurManager(wl_client *client, void *data, uint32_t version, uint32_t id)
+    {
+        createResource(client, &mbition_blur_manager_v1_interface, version, id, data);
+    }
+
+    static void createResource(wl_client *client, const wl_interface *interface, uint32_t version, uint32_t id, void *data)
+    {
+        wl_resource *resource = wl_resource_create(client, interface, version, id);
+        wl_resource_set_dispatcher(resource, dispatch, nullptr, data, nullptr);
+    }
+
+    static int dispatch(const void *, void *target, uint32_t opcode, const wl_message *message, wl_argument *arguments)
+    {
+        auto resource = static_cast<wl_resource *>(target);
+        auto compositor = static_cast<TestCompositor *>(wl_resource_get_user_data(resource));
+        if (std::strcmp(wl_resource_get_class(resource), mbition_blur_mask_v1_interface.name) == 0) {
+            ++compositor->m_maskRequests[opcode];
+        }
+
+        // Create the objects of new_id arguments, destroy the ones of destructors
+        const char *signature = message->signature;
+        for (int i = 0; *signature; ++signature) {
+            if (*signature == 'n') {
+                createResource(wl_resource_get_client(resource), message->types[i], wl_resource_get_version(resource), arguments[i].n, compositor);
+            }
+            if (std::isalpha(*signature)) {
+                ++i;
+            }
+        }
+        if (std::strcmp(message->name, "destroy") == 0) {
+            wl_resource_destroy(resource);
+        }
+        return 0;
+    }
+
+    wl_display *m_display = nullptr;
+    const char *m_socket = nullptr;
+    std::thread m_thread;
+    std::atomic<bool> m_quit = false;
+    std::array<std::atomic<int>, 8> m_maskRequests = {};
+};
+
+static TestCompositor *s_compositor = nullptr;
+
+/**
+ * Clients resend their masks on every change of their items, the masks are only
+ * sent again if they changed.
+ */
+class BlurClientTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testUnchangedDone();
+
+private:
+    void roundtrip();
+};
+
+void BlurClientTest::initTestCase()
+{
+    QTRY_VERIFY(BlurManager::instance()->isActive());
+    QTRY_VERIFY(Shm::instance()->isActive());
+}
+
+void BlurClientTest::roundtrip()
+{
+    auto waylandApp = qGuiApp->nativeInterface<QNativeInterface::QWaylandApplication>();
+    QVERIFY(waylandApp);
+    wl_display_roundtrip(waylandApp->display());
+}
+
+void BlurClientTest::testUnchangedDone()
+{
+    const int setMask = MBITION_BLUR_MASK_V1_SET_MASK;
+    const int setEncoding = MBITION_BLUR_MASK_V1_SET_MASK_ENCODING;
+    const int done = MBITION_BLUR_MASK_V1_DONE;
+
+    BlurMask mask(BlurManager::instance()->get_blur_mask());
+    QImage image(64, 64, QImage::Format_Grayscale8);
+    for (int y = 0; y < image.height(); ++y) {
+        std::memset(image.scanLine(y), y * 4, image.width());
+    }
+    mask.setGeometry(QRectF(0, 0, 64, 64));
+    mask.setMask(image);
+    mask.sendDone();
+    roundtrip();
+    QCOMPARE(s_compositor->maskRequests(setMask), 1);
+    QCOMPARE(s_compositor->maskRequests(done), 1);
+    const int encodings = s_compositor->maskRequests(setEncoding);
+
+    // Nothing changed, only done goes out
+    mask.sendDone();
+    roundtrip();
+    QCOMPARE(s_compositor->maskRequests(setMask), 1);
+    QCOMPARE(s_compositor->maskRequests(setEncoding), encodings);
+    QCOMPARE(s_compositor->maskRequests(done), 2);
+
+    // Grabbing the same pixels again doesn't change anything either
+    mask.setMask(image.copy());
+    mask.sendDone();
+    roundtrip();
+    QCOMPARE(s_compositor->maskRequests(setMask), 1);
+    QCOMPARE(s_compositor->maskRequests(done), 3);
+
+    image.scanLine(0)[0] = 255;
+    mask.setMask(image);
+    mask.sendDone();
+    roundtrip();
+    QCOMPARE(s_compositor->maskRequests(setMask), 2);
+    QCOMPARE(s_compositor->maskRequests(done), 4);
+}
+
+int main(int argc, char *argv[])
+{
+    // The client has to connect to the compositor of the test
+    TestCompositor compositor;
+    s_compositor = &compositor;
+    qputenv("WAYLAND_DISPLAY", compositor.socket());
+    qputenv("QT_QPA_PLATFORM", "wayland");
+
+    QGuiApplication app(argc, argv);
+    BlurClientTest test;
+    QTEST_SET_MAIN_SOURCE_PATH
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "blurclienttest.moc"
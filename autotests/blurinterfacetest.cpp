@@ -0,0 +1,218 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QSignalSpy>
+#include <QTest>
+
+#include "wayland/blurinterface.h"
+#include "wayland/clientconnection.h"
+#include "wayland/compositor.h"
+#include "wayland/display.h"
+#include "wayland/surface.h"
+
+#include "qwayland-server-mbition-blur-v1.h"
+
+#include <wayland-client.h>
+
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace KWin;
+
+/**
+ * A client on a socketpair. It talks to the blur manager through the interface
+ * tables of the server code, the requests are looked up by name.
+ */
+class TestClient
+{
+public:
+    explicit TestClient(Display *display)
+    {
+        int fds[2];
+        QVERIFY(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+        display->createClient(fds[0]);
+        m_display = wl_display_connect_to_fd(fds[1]);
+        m_registry = wl_display_get_registry(m_display);
+        static const wl_registry_listener listener = {
+            .global = global,
+            .global_remove = globalRemove,
+        };
+        wl_registry_add_listener(m_registry, &listener, this);
+    }
+
+    ~TestClient()
+    {
+        wl_display_disconnect(m_display);
+    }
+
+    template<typename... Args>
+    wl_proxy *request(wl_proxy *proxy, const wl_interface &interface, const char *name, const wl_interface *created, Args... args)
+    {
+        uint32_t opcode = 0;
+        while (std::strcmp(interface.methods[opcode].name, name) != 0) {
+            ++opcode;
+        }
+        const uint32_t flags = std::strcmp(name, "destroy") == 0 ? WL_MARSHAL_FLAG_DESTROY : 0;
+        return wl_proxy_marshal_flags(proxy, opcode, created, wl_proxy_get_version(proxy), flags, args...);
+    }
+
+    /// A 64x64 buffer the mask is read from
+    wl_buffer *createBuffer()
+    {
+        const int stride = 64 * 4;
+        const int fd = memfd_create("blurinterfacetest", MFD_CLOEXEC);
+        if (fd < 0 || ftruncate(fd, stride * 64) != 0) {
+            return nullptr;
+        }
+        wl_shm_pool *pool = wl_shm_create_pool(shm, fd, stride * 64);
+        wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, 64, 64, stride, WL_SHM_FORMAT_ARGB8888);
+        wl_shm_pool_destroy(pool);
+        close(fd);
+        return buffer;
+    }
+
+    wl_display *m_display = nullptr;
+    wl_registry *m_registry = nullptr;
+    wl_compositor *compositor = nullptr;
+    wl_shm *shm = nullptr;
+    wl_proxy *blurManager = nullptr;
+
+private:
+    static void global(void *data, wl_registry *registry, uint32_t name, const char *interface, uint32_t version)
+    {
+        auto client = static_cast<TestClient *>(data);
+        if (std::strcmp(interface, wl_compositor_interface.name) == 0) {
+            client->compositor = static_cast<wl_compositor *>(wl_registry_bind(registry, name, &wl_compositor_interface, 1));
+        } else if (std::strcmp(interface, wl_shm_interface.name) == 0) {
+            client->shm = static_cast<wl_shm *>(wl_registry_bind(registry, name, &wl_shm_interface, 1));
+        } else if (std::strcmp(interface, mbition_blur_manager_v1_interface.name) == 0) {
+            client->blurManager = static_cast<wl_proxy *>(wl_registry_bind(registry, name, &mbition_blur_manager_v1_interface, version));
+        }
+    }
+
+    static void globalRemove(void *, wl_registry *, uint32_t)
+    {
+    }
+};
+
+class BlurInterfaceTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+    void testDestroyBlurKeepSurface();
+
+private:
+    void roundtrip(TestClient &client);
+
+    std::unique_ptr<Display> m_display;
+    BlurNGManagerInterface *m_manager = nullptr;
+    QList<SurfaceInterface *> m_surfaces;
+};
+
+void BlurInterfaceTest::init()
+{
+    m_display = std::make_unique<Display>();
+    QVERIFY(m_display->start());
+    m_display->createShm();
+    auto compositor = new CompositorInterface(m_display.get(), m_display.get());
+    connect(compositor, &CompositorInterface::surfaceCreated, this, [this](SurfaceInterface *surface) {
+        m_surfaces.append(surface);
+    });
+    m_manager = new BlurNGManagerInterface(m_display.get(), m_display.get());
+    // The texture memory of every client is looked up on every mask upload
+    m_manager->setClientLimits({.maxMasks = 16, .maxPixels = 1 << 20, .maxTextureMemory = 1 << 22});
+}
+
+void BlurInterfaceTest::cleanup()
+{
+    m_surfaces.clear();
+    m_manager = nullptr;
+    m_display.reset();
+}
+
+void BlurInterfaceTest::roundtrip(TestClient &client)
+{
+    bool done = false;
+    static const wl_callback_listener listener = {
+        .done = [](void *data, wl_callback *, uint32_t) {
+            *static_cast<bool *>(data) = true;
+        },
+    };
+    wl_callback *callback = wl_display_sync(client.m_display);
+    wl_callback_add_listener(callback, &listener, &done);
+
+    // Both ends run on this thread, take turns without blocking
+    wl_event_loop *loop = wl_display_get_event_loop(*m_display);
+    while (!done) {
+        QVERIFY(wl_display_flush(client.m_display) >= 0);
+        wl_event_loop_dispatch(loop, 10);
+        wl_display_flush_clients(*m_display);
+        if (wl_display_prepare_read(client.m_display) == 0) {
+            wl_display_read_events(client.m_display);
+        }
+        QVERIFY(wl_display_dispatch_pending(client.m_display) >= 0);
+    }
+    wl_callback_destroy(callback);
+}
+
+void BlurInterfaceTest::testDestroyBlurKeepSurface()
+{
+    QSignalSpy blurChangedSpy(m_manager, &BlurNGManagerInterface::blurChanged);
+
+    TestClient first(m_display.get());
+    roundtrip(first);
+    QVERIFY(first.compositor && first.blurManager);
+    wl_surface *surface = wl_compositor_create_surface(first.compositor);
+    wl_proxy *blur = first.request(first.blurManager, mbition_blur_manager_v1_interface, "get_blur", &mbition_blur_surface_v1_interface, nullptr, surface);
+    roundtrip(first);
+    QCOMPARE(m_surfaces.size(), 1);
+    SurfaceInterface *firstSurface = m_surfaces.first();
+    QVERIFY(m_manager->surface(firstSurface));
+
+    // The surface stays, the blur is gone and the effect is told so
+    first.request(blur, mbition_blur_surface_v1_interface, "destroy", nullptr);
+    roundtrip(first);
+    QCOMPARE(m_manager->surface(firstSurface), nullptr);
+    QCOMPARE(blurChangedSpy.count(), 1);
+    QCOMPARE(blurChangedSpy.last().at(0).value<SurfaceInterface *>(), firstSurface);
+
+    // Another client committing a mask looks at the blur of every surface
+    TestClient second(m_display.get());
+    roundtrip(second);
+    QVERIFY(second.compositor && second.shm && second.blurManager);
+    wl_buffer *buffer = second.createBuffer();
+    QVERIFY(buffer);
+    wl_proxy *mask = second.request(second.blurManager, mbition_blur_manager_v1_interface, "get_blur_mask", &mbition_blur_mask_v1_interface, nullptr);
+    second.request(mask, mbition_blur_mask_v1_interface, "set_geometry", nullptr, 0, 0, 64u, 64u);
+    second.request(mask, mbition_blur_mask_v1_interface, "set_mask", nullptr, buffer);
+    second.request(mask, mbition_blur_mask_v1_interface, "done", nullptr);
+    wl_surface *secondSurface = wl_compositor_create_surface(second.compositor);
+    wl_proxy *secondBlur = second.request(second.blurManager, mbition_blur_manager_v1_interface, "get_blur", &mbition_blur_surface_v1_interface, nullptr, secondSurface);
+    second.request(secondBlur, mbition_blur_surface_v1_interface, "add_mask", nullptr, mask);
+    wl_surface_commit(secondSurface);
+    roundtrip(second);
+
+    QCOMPARE(m_surfaces.size(), 2);
+    QVERIFY(m_manager->surface(m_surfaces.last()));
+    QCOMPARE(m_manager->surface(firstSurface), nullptr);
+    const QList<BlurNGClientUsage> usage = m_manager->clientUsage();
+    QCOMPARE(usage.size(), 1);
+    QCOMPARE(usage.first().masks, 1u);
+
+    // The first client is still fine
+    wl_surface_commit(surface);
+    roundtrip(first);
+    QCOMPARE(m_manager->surface(firstSurface), nullptr);
+}
+
+QTEST_GUILESS_MAIN(BlurInterfaceTest)
+
+#include "blurinterfacetest.moc"
@@ -0,0 +1,140 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QTest>
+
+#include "blurfootprint.h"
+#include "kawasemodel.h"
+
+using namespace KWin;
+using namespace KawaseModel;
+
+/**
+ * Checks the footprint the effect derives from the blur strength against the CPU model
+ * of the chain. A padding that is too small shows as a seam at the edges of the blurred
+ * area, a repaint that is too small leaves stale blur next to damaged content.
+ */
+class EdgeTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testPadding_data();
+    void testPadding();
+    void testDamage_data();
+    void testDamage();
+};
+
+static const int s_width = 2048;
+
+// Content with detail at every frequency, so every tap the chain takes counts
+static Level background()
+{
+    Level level(s_width);
+    quint32 state = 1;
+    for (int i = 0; i < s_width; ++i) {
+        state = state * 1664525u + 1013904223u;
+        level[i] = (state >> 8) / float(1 << 24);
+    }
+    return level;
+}
+
+static void addStrengths()
+{
+    QTest::addColumn<int>("iterations");
+    QTest::addColumn<float>("offset");
+
+    // The offsets at both ends of every iteration count, see BlurNGEffect::initBlurNGStrengthValues()
+    const std::pair<int, float> strengths[] = {{1, 1.0f}, {1, 2.0f}, {2, 2.0f}, {2, 3.0f}, {3, 2.0f}, {3, 5.0f}, {4, 3.0f}, {4, 8.0f}};
+    for (const auto &[iterations, offset] : strengths) {
+        QTest::addRow("%d iterations, offset %.0f", iterations, offset) << iterations << offset;
+    }
+}
+
+void EdgeTest::testPadding_data()
+{
+    addStrengths();
+}
+
+void EdgeTest::testPadding()
+{
+    QFETCH(int, iterations);
+    QFETCH(float, offset);
+
+    const int expandSize = blurExpandSize(iterations, offset, 1.0);
+    const int alignment = 1 << iterations;
+
+    // The padded texture starts and ends on texels of the smallest level of the full
+    // screen chain, so that both chains sample the same grid
+    const int paddedLeft = 512;
+    const int blurLeft = paddedLeft + expandSize;
+    const int blurWidth = 256 + (alignment - (2 * expandSize) % alignment) % alignment;
+    const int paddedWidth = blurWidth + 2 * expandSize;
+    QCOMPARE(paddedWidth % alignment, 0);
+
+    const Level screen = background();
+    const Level reference = blur(screen, iterations, offset, s_exact);
+
+    const auto edgeError = [&](int left, int width) {
+        const Level padded = blur(Level(screen.begin() + left, screen.begin() + left + width), iterations, offset, s_exact);
+        float error = 0;
+        for (int x = blurLeft; x < blurLeft + blurWidth; ++x) {
+            error = std::max(error, std::abs(padded[x - left] - reference[x]));
+        }
+        return error;
+    };
+
+    QVERIFY(edgeError(paddedLeft, paddedWidth) < 1e-5f);
+
+    // Without the padding the edges sample the clamped border, which the test has to notice
+    QVERIFY(edgeError(blurLeft - alignment, blurWidth + 2 * alignment) > 1e-3f);
+}
+
+void EdgeTest::testDamage_data()
+{
+    addStrengths();
+}
+
+void EdgeTest::testDamage()
+{
+    QFETCH(int, iterations);
+    QFETCH(float, offset);
+
+    const int expandSize = blurExpandSize(iterations, offset, 1.0);
+    const QRect blurArea(800, 0, 400, 1);
+
+    const Level screen = background();
+    const Level reference = blur(screen, iterations, offset, s_exact);
+
+    // Damage right at the edge of the footprint, within the padding and inside the blurred area
+    const int damageLefts[] = {blurArea.left() - expandSize - 4, blurArea.left() - expandSize / 2, blurArea.left() + 100};
+    for (const int damageLeft : damageLefts) {
+        const QRect damage(damageLeft, 0, 4, 1);
+        Level damaged = screen;
+        for (int x = damage.left(); x <= damage.right(); ++x) {
+            damaged[x] = 1.0f - damaged[x];
+        }
+        const Level result = blur(damaged, iterations, offset, s_exact);
+
+        const QRect repaint = blurredDamage(damage, blurArea, expandSize);
+        bool changed = false;
+        for (int x = blurArea.left(); x <= blurArea.right(); ++x) {
+            if (std::abs(result[x] - reference[x]) > 1e-6f) {
+                changed = true;
+                QVERIFY2(repaint.contains(QPoint(x, 0)), qPrintable(QStringLiteral("%1 changed, repaint %2-%3").arg(x).arg(repaint.left()).arg(repaint.right())));
+            }
+        }
+        // A repaint without any change behind it only costs fill rate, but damage inside
+        // the blurred area has to show up
+        if (blurArea.intersects(damage)) {
+            QVERIFY(changed);
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(EdgeTest)
+
+#include "edgetest.moc"
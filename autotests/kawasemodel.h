@@ -0,0 +1,98 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * The passes of the dual Kawase shaders replayed on the CPU, with bilinear and clamped
+ * sampling. A horizontal gradient or a column of damage is constant along y, so one
+ * row is enough and the diagonal taps fall onto the horizontal ones.
+ *
+ * Every level is rounded to the mantissa of its format when it's written, 0 keeps
+ * the exact value.
+ */
+namespace KawaseModel
+{
+
+using Level = std::vector<float>;
+
+static const int s_exact = 0;
+static const int s_halfMantissa = 10;
+
+// Rounds to an unsigned float with a 5 bit exponent, as for RGBA16F, R11F, G11F and B10F
+inline float quantize(float value, int mantissa)
+{
+    if (mantissa == s_exact) {
+        return value;
+    }
+    if (value <= 0) {
+        return 0;
+    }
+    int exponent;
+    std::frexp(value, &exponent);
+    const float step = std::ldexp(1.0f, std::max(exponent - 1, -14) - mantissa);
+    return std::round(value / step) * step;
+}
+
+inline float sample(const Level &texture, float u)
+{
+    const float x = u * texture.size() - 0.5f;
+    const int x0 = std::floor(x);
+    const float f = x - x0;
+    const auto texel = [&texture](int i) {
+        return texture[std::clamp<int>(i, 0, texture.size() - 1)];
+    };
+    return texel(x0) * (1 - f) + texel(x0 + 1) * f;
+}
+
+// downsample.frag
+inline Level downsample(const Level &read, int width, float offset, int mantissa)
+{
+    Level draw(width);
+    const float halfpixel = 0.5f / read.size();
+    for (int i = 0; i < width; ++i) {
+        const float u = (i + 0.5f) / width;
+        const float sum = sample(read, u) * 4 + sample(read, u - halfpixel * offset) * 2 + sample(read, u + halfpixel * offset) * 2;
+        draw[i] = quantize(sum / 8, mantissa);
+    }
+    return draw;
+}
+
+// upsample.frag
+inline Level upsample(const Level &read, int width, float offset, int mantissa)
+{
+    Level draw(width);
+    const float halfpixel = 0.5f / read.size();
+    for (int i = 0; i < width; ++i) {
+        const float u = (i + 0.5f) / width;
+        const float sum = sample(read, u - halfpixel * 2 * offset) + sample(read, u + halfpixel * 2 * offset) + sample(read, u) * 2
+            + sample(read, u - halfpixel * offset) * 4 + sample(read, u + halfpixel * offset) * 4;
+        draw[i] = quantize(sum / 12, mantissa);
+    }
+    return draw;
+}
+
+/**
+ * Blurs @p background, the intermediate levels are rounded to @p mantissa. The final
+ * round is written to the output without rounding.
+ */
+inline Level blur(const Level &background, int iterations, float offset, int mantissa)
+{
+    std::vector<Level> levels{background};
+    for (int i = 1; i <= iterations; ++i) {
+        levels.push_back(downsample(levels[i - 1], background.size() >> i, offset, mantissa));
+    }
+    for (int i = iterations; i > 1; --i) {
+        levels[i - 1] = upsample(levels[i], levels[i - 1].size(), offset, mantissa);
+    }
+    return upsample(levels[1], background.size(), offset, s_exact);
+}
+
+} // namespace KawaseModel
@@ -0,0 +1,164 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QTest>
+
+#include "blurpainttracker.h"
+#include "blurrectlist.h"
+#include "blurspatialindex.h"
+
+#include <algorithm>
+
+using namespace KWin;
+
+/**
+ * The areas prePaintWindow() tracks from the bottom to the top of the stack: what is
+ * painted, what is blurred and which part of it stays visible.
+ */
+class OcclusionTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testRectListSubtract();
+    void testRectListMerge();
+    void testSpatialIndexUncovered();
+    void testPaintTrackerVisibleArea();
+};
+
+void OcclusionTest::testRectListSubtract()
+{
+    BlurNGRectList list;
+    list.add(QRegion(0, 0, 100, 100));
+    list.subtract(QRegion(25, 25, 50, 50));
+
+    QVERIFY(!list.intersects(QRect(30, 30, 40, 40)));
+    QVERIFY(list.intersects(QRect(0, 0, 10, 10)));
+    QVERIFY(list.intersects(QRect(20, 40, 10, 10)));
+    QVERIFY(list.intersects(QRect(70, 40, 10, 10)));
+    QVERIFY(list.intersects(QRect(40, 70, 10, 10)));
+
+    list.subtract(QRegion(0, 0, 100, 100));
+    QVERIFY(list.isEmpty());
+
+    list.add(QRegion(0, 0, 10, 10));
+    list.clear();
+    QVERIFY(!list.intersects(QRect(0, 0, 10, 10)));
+}
+
+void OcclusionTest::testRectListMerge()
+{
+    BlurNGRectList list;
+    list.add(QRect(0, 0, 100, 100));
+
+    // Covered already
+    list.add(QRect(10, 10, 20, 20));
+    list.add(QRect(0, 0, 100, 100));
+    QCOMPARE(list.size(), 1);
+
+    // Touching with a full edge
+    list.add(QRect(100, 0, 50, 100));
+    QCOMPARE(list.size(), 1);
+    QCOMPARE(*list.begin(), QRect(0, 0, 150, 100));
+    list.add(QRect(0, 100, 150, 20));
+    QCOMPARE(list.size(), 1);
+    QCOMPARE(*list.begin(), QRect(0, 0, 150, 120));
+
+    // Swallows what it covers
+    list.add(QRect(300, 0, 10, 10));
+    list.add(QRect(320, 0, 10, 10));
+    QCOMPARE(list.size(), 3);
+    list.add(QRect(300, 0, 100, 100));
+    QCOMPARE(list.size(), 2);
+
+    // Grows into a rect that was checked before
+    list.add(QRect(0, 200, 50, 50));
+    list.add(QRect(100, 200, 50, 50));
+    list.add(QRect(50, 200, 50, 50));
+    QCOMPARE(list.size(), 3);
+    QVERIFY(std::find(list.begin(), list.end(), QRect(0, 200, 150, 50)) != list.end());
+
+    // Overlapping without forming a rect stays apart
+    list.add(QRect(140, 110, 20, 20));
+    QCOMPARE(list.size(), 4);
+}
+
+void OcclusionTest::testSpatialIndexUncovered()
+{
+    QRegion visibleArea;
+    BlurNGSpatialIndex index;
+    index.insert(QRect(100, 100, 200, 200), &visibleArea);
+    index.updateVisibleAreas();
+    QCOMPARE(visibleArea, QRegion(100, 100, 200, 200));
+
+    const QRegion paint(0, 0, 400, 400);
+    QVERIFY(index.intersectsUncovered(paint, QRegion()));
+    QVERIFY(!index.intersectsUncovered(paint, QRegion(50, 50, 300, 300)));
+    // Covered only by two rects together
+    QRegion split(50, 50, 150, 300);
+    split += QRect(200, 50, 150, 300);
+    QVERIFY(index.intersectsUncovered(paint, split));
+
+    QRegion united(500, 500, 10, 10);
+    index.unite(united);
+    QCOMPARE(united, QRegion(500, 500, 10, 10) + QRegion(100, 100, 200, 200));
+
+    // The visible area follows what is subtracted, in the next frame as well
+    index.subtract(QRegion(100, 100, 50, 50));
+    index.updateVisibleAreas();
+    QCOMPARE(visibleArea, QRegion(100, 100, 200, 200) - QRegion(100, 100, 50, 50));
+    index.clear();
+    index.insert(QRect(100, 100, 200, 200), &visibleArea);
+    index.updateVisibleAreas();
+    QCOMPARE(visibleArea, QRegion(100, 100, 200, 200));
+}
+
+void OcclusionTest::testPaintTrackerVisibleArea()
+{
+    BlurNGPaintTracker tracker;
+    tracker.setExpandSize(10);
+    BlurNGPaintTracker::WindowCache blurredCache;
+    BlurNGPaintTracker::WindowCache coverCache;
+    QRegion visibleArea;
+
+    const BlurNGPaintTracker::BlurredWindow blurred{
+        .area = QRect(0, 0, 200, 200),
+        .cached = true,
+        .visibleArea = &visibleArea,
+    };
+    QRegion paint;
+    QRegion opaque;
+    QVERIFY(!tracker.addWindow(paint, opaque, blurredCache, &blurred));
+
+    // An opaque window over half of it shrinks by the expand size over the blur
+    paint = QRegion();
+    opaque = QRegion(100, 0, 200, 200);
+    tracker.addWindow(paint, opaque, coverCache, nullptr);
+    QCOMPARE(opaque, QRegion(110, 10, 180, 180));
+    tracker.updateVisibleAreas();
+    QCOMPARE(visibleArea, QRegion(0, 0, 200, 200) - QRegion(110, 10, 180, 180));
+
+    // Damage below reaches the blurred area only as far as the blur samples
+    tracker.clear();
+    paint = QRegion(300, 50, 20, 20);
+    opaque = QRegion();
+    BlurNGPaintTracker::WindowCache belowCache;
+    tracker.addWindow(paint, opaque, belowCache, nullptr);
+    QRegion blurredPaint;
+    opaque = QRegion();
+    QVERIFY(!tracker.addWindow(blurredPaint, opaque, blurredCache, &blurred));
+    QVERIFY(blurredPaint.isEmpty());
+
+    tracker.clear();
+    paint = QRegion(205, 50, 20, 20);
+    tracker.addWindow(paint, opaque, belowCache, nullptr);
+    QVERIFY(tracker.addWindow(blurredPaint, opaque, blurredCache, &blurred));
+    QCOMPARE(blurredPaint, QRegion(QRect(195, 40, 5, 40)));
+}
+
+QTEST_GUILESS_MAIN(OcclusionTest)
+
+#include "occlusiontest.moc"
@@ -0,0 +1,277 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QRect>
+#include <QTest>
+
+#include "qwayland-server-mbition-blur-v1.h"
+
+#include <wayland-client-core.h>
+
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * Sums up the regions it gets, so the benchmark reads the arguments the way
+ * the effect does.
+ */
+class BlurSurface : public QtWaylandServer::mbition_blur_surface_v1
+{
+public:
+    int regions = 0;
+    qint64 sum = 0;
+
+protected:
+#ifdef SCANNER_ZERO_COPY_ARGUMENTS
+    void mbition_blur_surface_v1_set_region(Resource *, std::span<const std::byte> rects) override
+    {
+        addRegion(rects.data(), rects.size());
+    }
+#else
+    void mbition_blur_surface_v1_set_region(Resource *, wl_array *rects) override
+    {
+        addRegion(rects->data, rects->size);
+    }
+#endif
+
+private:
+    void addRegion(const void *data, size_t size)
+    {
+        const auto values = static_cast<const int32_t *>(data);
+        for (size_t i = 0; i < size / sizeof(int32_t); ++i) {
+            sum += values[i];
+        }
+        ++regions;
+    }
+};
+
+/**
+ * Keeps the geometry like the mask of the effect, with the dispatcher if the
+ * scanner generates it
+ */
+class BlurMask final
+#ifdef SCANNER_CRTP_DISPATCH
+    : public QtWaylandServer::mbition_blur_mask_v1_dispatch<BlurMask>
+#else
+    : public QtWaylandServer::mbition_blur_mask_v1
+#endif
+{
+public:
+    int geometries = 0;
+    QRect geometry;
+
+    // Public, the dispatcher calls it
+    void mbition_blur_mask_v1_set_geometry(Resource *, int32_t x, int32_t y, uint32_t width, uint32_t height) override
+    {
+        geometry = QRect(x, y, width, height);
+        ++geometries;
+    }
+};
+
+/**
+ * Builds against the code the scanner generates with the options of the
+ * build, once per combination, so the options compile and can be compared.
+ */
+class ScannerBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testResourceMap();
+    void benchmarkResourceChurn_data();
+    void benchmarkResourceChurn();
+    void benchmarkSetRegion_data();
+    void benchmarkSetRegion();
+    void testFromResource();
+    void benchmarkSetGeometry();
+
+private:
+    static uint32_t opcode(const wl_interface &interface, const char *request);
+    void dispatchUntil(const int &handled, int target);
+
+    wl_display *m_display = nullptr;
+    wl_client *m_client = nullptr;
+    wl_display *m_clientDisplay = nullptr;
+};
+
+void ScannerBenchmark::initTestCase()
+{
+    int fds[2];
+    QCOMPARE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+    m_display = wl_display_create();
+    m_client = wl_client_create(m_display, fds[0]);
+    QVERIFY(m_client);
+    m_clientDisplay = wl_display_connect_to_fd(fds[1]);
+    QVERIFY(m_clientDisplay);
+}
+
+void ScannerBenchmark::cleanupTestCase()
+{
+    wl_display_disconnect(m_clientDisplay);
+    wl_client_destroy(m_client);
+    wl_display_destroy(m_display);
+}
+
+void ScannerBenchmark::testResourceMap()
+{
+    // Whatever the map is, users of resourceMap() see the API of QMultiMap
+    QtWaylandServer::mbition_blur_mask_v1 masks;
+    QList<QtWaylandServer::mbition_blur_mask_v1::Resource *> added;
+    for (int i = 0; i < 3; ++i) {
+        added.prepend(masks.add(m_client, 1));
+    }
+
+    // Without the intrusive map resourceMap() returns a copy, so look again after each change
+    QCOMPARE(masks.resourceMap().size(), 3);
+    QCOMPARE(masks.resourceMap().count(m_client), 3);
+    QVERIFY(masks.resourceMap().contains(m_client));
+    QCOMPARE(masks.resourceMap().uniqueKeys(), QList<wl_client *>{m_client});
+    QCOMPARE(masks.resourceMap().value(m_client), added.first());
+    QCOMPARE(masks.resourceMap().values(m_client), added);
+
+    wl_resource_destroy(added.takeAt(1)->handle);
+    QCOMPARE(masks.resourceMap().count(m_client), 2);
+    QCOMPARE(masks.resourceMap().values(m_client), added);
+
+    for (auto resource : std::as_const(added)) {
+        wl_resource_destroy(resource->handle);
+    }
+    QVERIFY(!masks.resourceMap().contains(m_client));
+    QVERIFY(masks.resourceMap().isEmpty());
+}
+
+void ScannerBenchmark::benchmarkResourceChurn_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("100") << 100;
+    QTest::newRow("1000") << 1000;
+    QTest::newRow("10000") << 10000;
+}
+
+void ScannerBenchmark::benchmarkResourceChurn()
+{
+    QFETCH(int, count);
+
+    QtWaylandServer::mbition_blur_mask_v1 masks;
+    QList<QtWaylandServer::mbition_blur_mask_v1::Resource *> added(count);
+
+    // Clients create and destroy a mask per blurred item, in any order
+    QBENCHMARK {
+        for (int i = 0; i < count; ++i) {
+            added[i] = masks.add(m_client, 1);
+        }
+        for (int i = 0; i < count; i += 2) {
+            wl_resource_destroy(added[i]->handle);
+        }
+        for (int i = 1; i < count; i += 2) {
+            wl_resource_destroy(added[i]->handle);
+        }
+    }
+    QVERIFY(masks.resourceMap().isEmpty());
+}
+
+uint32_t ScannerBenchmark::opcode(const wl_interface &interface, const char *request)
+{
+    uint32_t opcode = 0;
+    while (std::strcmp(interface.methods[opcode].name, request) != 0) {
+        ++opcode;
+    }
+    return opcode;
+}
+
+void ScannerBenchmark::dispatchUntil(const int &handled, int target)
+{
+    QVERIFY(wl_display_flush(m_clientDisplay) >= 0);
+    wl_event_loop *loop = wl_display_get_event_loop(m_display);
+    while (handled < target) {
+        wl_event_loop_dispatch(loop, -1);
+    }
+}
+
+void ScannerBenchmark::benchmarkSetRegion_data()
+{
+    QTest::addColumn<int>("rects");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("16") << 16;
+    QTest::newRow("128") << 128;
+}
+
+void ScannerBenchmark::benchmarkSetRegion()
+{
+    QFETCH(int, rects);
+
+    // The client allocates the id, the server binds the resource to it without a roundtrip
+    auto proxy = wl_proxy_create(reinterpret_cast<wl_proxy *>(m_clientDisplay), &mbition_blur_surface_v1_interface);
+    BlurSurface surface;
+    surface.add(m_client, wl_proxy_get_id(proxy), mbition_blur_surface_v1_interface.version);
+
+    const uint32_t setRegion = opcode(mbition_blur_surface_v1_interface, "set_region");
+
+    QList<int32_t> values(rects * 4, 1);
+    wl_array array;
+    array.size = values.size() * sizeof(int32_t);
+    array.alloc = 0;
+    array.data = values.data();
+
+    const int batch = 64;
+    QBENCHMARK {
+        const int target = surface.regions + batch;
+        for (int i = 0; i < batch; ++i) {
+            wl_proxy_marshal_flags(proxy, setRegion, nullptr, wl_proxy_get_version(proxy), 0, &array);
+        }
+        dispatchUntil(surface.regions, target);
+    }
+    QCOMPARE(surface.sum, qint64(surface.regions) * rects * 4);
+
+    wl_proxy_destroy(proxy);
+}
+
+void ScannerBenchmark::testFromResource()
+{
+    BlurMask mask;
+    auto resource = mask.add(m_client, 1);
+    QCOMPARE(BlurMask::Resource::fromResource(resource->handle), resource);
+
+    // Neither resources of other interfaces nor masks bound elsewhere are ours
+    BlurSurface surface;
+    auto other = surface.add(m_client, 1);
+    QCOMPARE(BlurMask::Resource::fromResource(other->handle), nullptr);
+    auto foreign = wl_resource_create(m_client, &mbition_blur_mask_v1_interface, 1, 0);
+    QCOMPARE(BlurMask::Resource::fromResource(foreign), nullptr);
+
+    wl_resource_destroy(foreign);
+    wl_resource_destroy(other->handle);
+    wl_resource_destroy(resource->handle);
+}
+
+void ScannerBenchmark::benchmarkSetGeometry()
+{
+    auto proxy = wl_proxy_create(reinterpret_cast<wl_proxy *>(m_clientDisplay), &mbition_blur_mask_v1_interface);
+    BlurMask mask;
+    mask.add(m_client, wl_proxy_get_id(proxy), mbition_blur_mask_v1_interface.version);
+
+    const uint32_t setGeometry = opcode(mbition_blur_mask_v1_interface, "set_geometry");
+    const int batch = 256;
+    QBENCHMARK {
+        const int target = mask.geometries + batch;
+        for (int i = 0; i < batch; ++i) {
+            wl_proxy_marshal_flags(proxy, setGeometry, nullptr, wl_proxy_get_version(proxy), 0, i, i, 64u, 64u);
+        }
+        dispatchUntil(mask.geometries, target);
+    }
+    QCOMPARE(mask.geometry, QRect(batch - 1, batch - 1, 64, 64));
+
+    wl_proxy_destroy(proxy);
+}
+
+QTEST_GUILESS_MAIN(ScannerBenchmark)
+
+#include "scannerbenchmark.moc"
@@ -10,25 +10,37 @@
 #include "blur.h"
 // KConfigSkeleton
 #include "blurconfig.h"
+#include "blurfootprint.h"
+#include "blurmemory.h"
+#include "blurshape.h"
 
+#include "core/output.h"
 #include "core/pixelgrid.h"
+#include "core/renderloop.h"
 #include "core/rendertarget.h"
 #include "core/renderviewport.h"
 #include "effect/effecthandler.h"
 #include "opengl/glplatform.h"
+#include "opengl/openglcontext.h"
+#include "utils/version.h"
 #include "wayland/blur.h"
+#include "wayland/clientconnection.h"
 #include "wayland/display.h"
 #include "wayland/surface.h"
 #include "wayland/blurinterface.h"
 
 #include <QGuiApplication>
+#include <QMap>
 #include <QMatrix4x4>
 #include <QScreen>
 #include <QTime>
 #include <QTimer>
 #include <QWindow>
+#include <algorithm>
+#include <array>
 #include <cmath> // for ceil()
 #include <cstdlib>
+#include <utility>
 
 #include <KConfigGroup>
 #include <KSharedConfig>
@@ -46,45 +58,47 @@ static const QByteArray s_blurAtomName = QByteArrayLiteral("_KDE_NET_WM_BLUR_BEH
 BlurNGManagerInterface *BlurNGEffect::s_blurManager = nullptr;
 QTimer *BlurNGEffect::s_blurManagerRemoveTimer = nullptr;
 
+static BlurNGClientLimits configuredClientLimits()
+{
+    return BlurNGClientLimits{
+        .maxMasks = BlurNGConfig::maxMasksPerClient(),
+        .maxPixels = BlurNGConfig::maxMaskPixelsPerClient(),
+        .maxTextureMemory = qint64(BlurNGConfig::maxMaskMemoryPerClient()) * 1024 * 1024,
+    };
+}
+
+// The clock of the presentation times, for feedback that is sent outside of a frame
+static std::chrono::milliseconds steadyTime()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch());
+}
+
 BlurNGEffect::BlurNGEffect()
 {
     BlurNGConfig::instance(effects->config());
 
-    m_downsamplePass.shader = ShaderManager::instance()->generateShaderFromFile(ShaderTrait::MapTexture,
-                                                                                QStringLiteral(":/effects/blurng/shaders/vertex.vert"),
-                                                                                QStringLiteral(":/effects/blurng/shaders/downsample.frag"));
-    if (!m_downsamplePass.shader) {
-        qCWarning(KWIN_BLUR) << "Failed to load downsampling pass shader";
-        return;
-    } else {
-        m_downsamplePass.mvpMatrixLocation = m_downsamplePass.shader->uniformLocation("modelViewProjectionMatrix");
-        m_downsamplePass.offsetLocation = m_downsamplePass.shader->uniformLocation("offset");
-        m_downsamplePass.halfpixelLocation = m_downsamplePass.shader->uniformLocation("halfpixel");
-    }
+    m_evictionTimer.setSingleShot(true);
+    connect(&m_evictionTimer, &QTimer::timeout, this, &BlurNGEffect::evictIdleRenderData);
 
-    m_upsamplePass.shader = ShaderManager::instance()->generateShaderFromFile(ShaderTrait::MapTexture,
-                                                                              QStringLiteral(":/effects/blurng/shaders/vertex.vert"),
-                                                                              QStringLiteral(":/effects/blurng/shaders/upsample.frag"));
-    if (!m_upsamplePass.shader) {
-        qCWarning(KWIN_BLUR) << "Failed to load upsampling pass shader";
-        return;
-    } else {
-        m_upsamplePass.mvpMatrixLocation = m_upsamplePass.shader->uniformLocation("modelViewProjectionMatrix");
-        m_upsamplePass.offsetLocation = m_upsamplePass.shader->uniformLocation("offset");
-        m_upsamplePass.halfpixelLocation = m_upsamplePass.shader->uniformLocation("halfpixel");
-    }
+    // Commits of one event loop turn share a single context switch and round of uploads
+    m_uploadTimer.setSingleShot(true);
+    m_uploadTimer.setInterval(0);
+    connect(&m_uploadTimer, &QTimer::timeout, this, &BlurNGEffect::startStagedUploads);
 
-    m_noisePass.shader = ShaderManager::instance()->generateShaderFromFile(ShaderTrait::MapTexture,
-                                                                           QStringLiteral(":/effects/blurng/shaders/vertex.vert"),
-                                                                           QStringLiteral(":/effects/blurng/shaders/noise.frag"));
-    if (!m_noisePass.shader) {
-        qCWarning(KWIN_BLUR) << "Failed to load noise pass shader";
-        return;
-    } else {
-        m_noisePass.mvpMatrixLocation = m_noisePass.shader->uniformLocation("modelViewProjectionMatrix");
-        m_noisePass.noiseTextureSizeLocation = m_noisePass.shader->uniformLocation("noiseTextureSize");
-        m_noisePass.texStartPosLocation = m_noisePass.shader->uniformLocation("texStartPos");
-    }
+    m_reblurTimer.setSingleShot(true);
+    connect(&m_reblurTimer, &QTimer::timeout, this, [this] {
+        QRegion area;
+        for (const QRect &rect : m_deferredArea) {
+            area += rect;
+        }
+        m_deferredArea.clear();
+        effects->addRepaint(area);
+    });
+
+    // Polls the driver while the programs are linked in the background
+    m_linkPollTimer.setSingleShot(true);
+    m_linkPollTimer.setInterval(std::chrono::milliseconds(16));
+    connect(&m_linkPollTimer, &QTimer::timeout, this, &BlurNGEffect::pollProgramLinking);
 
     initBlurNGStrengthValues();
     reconfigure(ReconfigureAll);
@@ -101,15 +115,38 @@ BlurNGEffect::BlurNGEffect()
         s_blurManagerRemoveTimer->stop();
         if (!s_blurManager) {
             s_blurManager = new BlurNGManagerInterface(effects->waylandDisplay(), s_blurManagerRemoveTimer);
+        }
+        s_blurManager->setClientLimits(configuredClientLimits());
 
-            connect(s_blurManager, &BlurNGManagerInterface::blurChanged, this, [this](SurfaceInterface *surface) {
-                auto w = effects->findWindow(surface);
-                if (w) {
-                    updateBlurRegion(w);
-                    effects->addRepaint(w->frameGeometry());
+        // The manager outlives compositing restarts, every effect instance needs its own connection
+        connect(s_blurManager, &BlurNGManagerInterface::blurChanged, this, [this](SurfaceInterface *surface, const QRegion &damage) {
+            auto w = effects->findWindow(surface);
+            if (w) {
+                updateBlurRegion(w);
+                // Only the area where the blur appeared, disappeared or changed needs repainting
+                effects->addRepaint(damage.translated(w->pos().toPoint()));
+
+                auto blurSurface = s_blurManager->surface(surface);
+                auto it = m_windows.find(w);
+                if (blurSurface && it != m_windows.end() && w->isOnCurrentDesktop() && !w->isMinimized()) {
+                    // Start the uploads soon after the commit, the next frame only has to pick them up
+                    it->second.uploadStaged = true;
+                    if (!m_uploadTimer.isActive()) {
+                        m_uploadTimer.start();
+                    }
                 }
-            });
-        }
+
+                // The blur of windows without blur data or that aren't shown isn't painted, don't keep
+                // the client waiting. Windows off every screen wouldn't even get a frame.
+                if (blurSurface && blurSurface->hasAppliedCallbacks() && (it == m_windows.end() || !canPresentBlur(w))) {
+                    blurSurface->sendApplied(steadyTime());
+                    if (it != m_windows.end()) {
+                        it->second.appliedPending = false;
+                        it->second.appliedOutput = nullptr;
+                    }
+                }
+            }
+        });
     }
 
     connect(effects, &EffectsHandler::windowAdded, this, &BlurNGEffect::slotWindowAdded);
@@ -129,10 +166,92 @@ BlurNGEffect::~BlurNGEffect()
 {
     // When compositing is restarted, avoid removing the manager immediately.
     if (s_blurManager) {
+        // Nothing presents the blur anymore
+        for (auto &[w, data] : m_windows) {
+            auto blurSurface = data.appliedPending || data.appliedOutput ? s_blurManager->surface(w->surface()) : nullptr;
+            if (blurSurface) {
+                blurSurface->sendApplied(steadyTime());
+            }
+        }
         s_blurManagerRemoveTimer->start(1000);
     }
 }
 
+bool BlurNGEffect::ensurePrograms()
+{
+    switch (m_programState) {
+    case ProgramState::Ready:
+        return true;
+    case ProgramState::Failed:
+        return false;
+    case ProgramState::None:
+        // The programs are only built once a window asks for blur, sessions that
+        // never use it don't pay for the compilation.
+        m_downsamplePass.shader = BlurNGProgram::create(QStringLiteral(":/effects/blurng/shaders/vertex.vert"),
+                                                        QStringLiteral(":/effects/blurng/shaders/downsample.frag"));
+        m_upsamplePass.shader = BlurNGProgram::create(QStringLiteral(":/effects/blurng/shaders/vertex.vert"),
+                                                      QStringLiteral(":/effects/blurng/shaders/upsample.frag"));
+        m_upsampleRectPass.shader = BlurNGProgram::create(QStringLiteral(":/effects/blurng/shaders/vertex.vert"),
+                                                          QStringLiteral(":/effects/blurng/shaders/upsample.frag"),
+                                                          QByteArrayLiteral("#define RECT_REGION\n"));
+        m_noisePass.shader = BlurNGProgram::create(QStringLiteral(":/effects/blurng/shaders/vertex.vert"),
+                                                   QStringLiteral(":/effects/blurng/shaders/noise.frag"));
+        m_programState = ProgramState::Linking;
+        break;
+    case ProgramState::Linking:
+        break;
+    }
+
+    const std::array<std::pair<BlurNGProgram *, const char *>, 4> programs = {{
+        {m_downsamplePass.shader.get(), "downsampling"},
+        {m_upsamplePass.shader.get(), "upsampling"},
+        {m_upsampleRectPass.shader.get(), "rect upsampling"},
+        {m_noisePass.shader.get(), "noise"},
+    }};
+
+    bool linking = false;
+    for (const auto &[program, name] : programs) {
+        if (!program || program->status() == BlurNGProgram::Status::Failed) {
+            qCWarning(KWIN_BLUR) << "Failed to load" << name << "pass shader";
+            m_programState = ProgramState::Failed;
+            m_valid = false;
+            return false;
+        }
+        linking |= program->status() == BlurNGProgram::Status::Linking;
+    }
+
+    // With GL_KHR_parallel_shader_compile the driver may still be working on them
+    if (linking) {
+        return false;
+    }
+
+    m_downsamplePass.mvpMatrixLocation = m_downsamplePass.shader->uniformLocation("modelViewProjectionMatrix");
+    m_downsamplePass.offsetLocation = m_downsamplePass.shader->uniformLocation("offset");
+    m_downsamplePass.halfpixelLocation = m_downsamplePass.shader->uniformLocation("halfpixel");
+
+    m_upsamplePass.mvpMatrixLocation = m_upsamplePass.shader->uniformLocation("modelViewProjectionMatrix");
+    m_upsamplePass.offsetLocation = m_upsamplePass.shader->uniformLocation("offset");
+    m_upsamplePass.halfpixelLocation = m_upsamplePass.shader->uniformLocation("halfpixel");
+    m_upsamplePass.finalRoundLocation = m_upsamplePass.shader->uniformLocation("finalRound");
+    m_upsamplePass.alphaMaskLocation = m_upsamplePass.shader->uniformLocation("alphaMask");
+    m_upsamplePass.originalLocation = m_upsamplePass.shader->uniformLocation("original");
+    m_upsamplePass.backgroundScaleLocation = m_upsamplePass.shader->uniformLocation("backgroundScale");
+    m_upsamplePass.backgroundOffsetLocation = m_upsamplePass.shader->uniformLocation("backgroundOffset");
+
+    m_upsampleRectPass.mvpMatrixLocation = m_upsampleRectPass.shader->uniformLocation("modelViewProjectionMatrix");
+    m_upsampleRectPass.offsetLocation = m_upsampleRectPass.shader->uniformLocation("offset");
+    m_upsampleRectPass.halfpixelLocation = m_upsampleRectPass.shader->uniformLocation("halfpixel");
+    m_upsampleRectPass.backgroundScaleLocation = m_upsampleRectPass.shader->uniformLocation("backgroundScale");
+    m_upsampleRectPass.backgroundOffsetLocation = m_upsampleRectPass.shader->uniformLocation("backgroundOffset");
+
+    m_noisePass.mvpMatrixLocation = m_noisePass.shader->uniformLocation("modelViewProjectionMatrix");
+    m_noisePass.noiseTextureSizeLocation = m_noisePass.shader->uniformLocation("noiseTextureSize");
+    m_noisePass.texStartPosLocation = m_noisePass.shader->uniformLocation("texStartPos");
+
+    m_programState = ProgramState::Ready;
+    return true;
+}
+
 void BlurNGEffect::initBlurNGStrengthValues()
 {
     // This function creates an array of blur strength values that are evenly distributed
@@ -154,19 +273,15 @@ void BlurNGEffect::initBlurNGStrengthValues()
      *
      * The maxOffset value is the maximum offset value for an iteration before we
      * get diagonal line artifacts because of the nature of the dual kawase blur algorithm.
-     *
-     * The expandSize value is the minimum value for an iteration before we reach the end
-     * of a texture in the shader and sample outside of the area that was copied into the
-     * texture from the screen.
      */
 
-    // {minOffset, maxOffset, expandSize}
-    blurOffsets.append({1.0, 2.0, 10}); // Down sample size / 2
-    blurOffsets.append({2.0, 3.0, 20}); // Down sample size / 4
-    blurOffsets.append({2.0, 5.0, 50}); // Down sample size / 8
-    blurOffsets.append({3.0, 8.0, 150}); // Down sample size / 16
-    // blurOffsets.append({5.0, 10.0, 400}); // Down sample size / 32
-    // blurOffsets.append({7.0, ?.0});       // Down sample size / 64
+    // {minOffset, maxOffset}
+    blurOffsets.append({1.0, 2.0}); // Down sample size / 2
+    blurOffsets.append({2.0, 3.0}); // Down sample size / 4
+    blurOffsets.append({2.0, 5.0}); // Down sample size / 8
+    blurOffsets.append({3.0, 8.0}); // Down sample size / 16
+    // blurOffsets.append({5.0, 10.0}); // Down sample size / 32
+    // blurOffsets.append({7.0, ?.0});  // Down sample size / 64
 
     float offsetSum = 0;
 
@@ -199,28 +314,40 @@ void BlurNGEffect::reconfigure(ReconfigureFlags /*flags*/)
     Q_ASSERT(blurStrength < blurStrengthValues.size());
     m_iterationCount = blurStrengthValues[blurStrength].iteration;
     m_offset = blurStrengthValues[blurStrength].offset;
-    m_expandSize = blurOffsets[m_iterationCount - 1].expandSize;
+
+    // Blurring at a reduced resolution takes the place of the first downsample passes. Drop
+    // those and scale the offset by what remains, so the visual radius stays the same.
+    m_workingScale = std::clamp(BlurNGConfig::workingScale(), 0.125, 1.0);
+    if (m_workingScale < 1.0) {
+        const size_t skippedIterations = std::floor(std::log2(1.0 / m_workingScale));
+        const size_t iterationCount = std::max<size_t>(1, m_iterationCount - std::min(skippedIterations, m_iterationCount));
+        const float offset = m_offset * m_workingScale * (1 << (m_iterationCount - iterationCount));
+        m_offset = std::max(1, int(std::round(std::min(offset, blurOffsets[iterationCount - 1].maxOffset))));
+        m_iterationCount = iterationCount;
+    }
+
+    m_expandSize = blurExpandSize(m_iterationCount, m_offset, m_workingScale);
+    m_paintTracker.setExpandSize(m_expandSize);
+
     m_noiseStrength = BlurNGConfig::noiseStrength();
-    m_blurUpdateInterval = BlurNGConfig::updateInterval();
+    m_maxStaleness = std::chrono::milliseconds(BlurNGConfig::maxStaleness());
 
-    if (m_blurUpdateInterval < 1)
-    {
-        m_blurUpdateInterval = 1;
+    m_reducedPrecisionChain = BlurNGConfig::reducedPrecisionChain();
+
+    m_renderDataIdleTimeout = std::chrono::milliseconds(BlurNGConfig::renderDataIdleTimeout());
+    m_hibernateBackdrop = BlurNGConfig::hibernateBackdrop();
+    if (m_renderDataIdleTimeout.count() == 0) {
+        m_evictionTimer.stop();
+    }
+
+    if (s_blurManager) {
+        s_blurManager->setClientLimits(configuredClientLimits());
     }
 
     // Update all windows for the blur to take effect
     effects->addRepaintFull();
 }
 
-QRegion BlurNGEffect::blurRegion(EffectWindow *w) const
-{
-    QRegion region;
-    if (auto it = m_windows.find(w); it != m_windows.end()) {
-        region = it->second.region;
-    }
-    return region;
-}
-
 void BlurNGEffect::updateBlurRegion(EffectWindow *w)
 {
     Q_ASSERT(w);
@@ -239,8 +366,15 @@ void BlurNGEffect::updateBlurRegion(EffectWindow *w)
     auto blurSurface = s_blurManager->surface(surf);
     if (blurSurface) {
         BlurNGEffectData &data = m_windows[w];
-        data.content = blurSurface->mask();
-        data.region = blurSurface->region();
+        // Compositing the mask is deferred to prePaintScreen(), so that several changes
+        // within a frame cost a single pass. The blurred area follows once the masks
+        // that cover it are uploaded.
+        data.maskDirty = true;
+        data.pendingRegion = blurSurface->region();
+        data.pendingRectRegion = blurSurface->rectRegion();
+        data.appliedPending = blurSurface->hasAppliedCallbacks();
+        // The frame in flight doesn't show this commit yet
+        data.appliedOutput = nullptr;
     } else {
         if (auto it = m_windows.find(w); it != m_windows.end()) {
             effects->makeOpenGLContextCurrent();
@@ -249,6 +383,112 @@ void BlurNGEffect::updateBlurRegion(EffectWindow *w)
     }
 }
 
+QRegion BlurNGEffect::resolveBlurMasks(Output *screen)
+{
+    QRegion changed;
+    // Uploads allocate the textures of the masks, compositing them the texture of the window
+    bool allocated = false;
+    for (auto &[w, data] : m_windows) {
+        if (!data.maskDirty) {
+            continue;
+        }
+        // Windows that are not shown keep their dirty flag until they are
+        if (!w->isOnCurrentDesktop() || w->isMinimized()) {
+            continue;
+        }
+        if (screen && !w->frameGeometry().intersects(screen->geometry())) {
+            continue;
+        }
+
+        auto blurSurface = s_blurManager->surface(w->surface());
+        data.uploadStaged = false;
+        allocated |= bool(blurSurface);
+        if (blurSurface && blurSurface->uploadMasks(&m_maskUploader)) {
+            // The previous masks and regions stay in use until the GPU has copied the new masks
+            m_pendingUploadArea += data.region.translated(w->pos().toPoint());
+            continue;
+        }
+        changed += (data.region | data.pendingRegion).translated(w->pos().toPoint());
+        data.region = data.pendingRegion;
+        data.rectRegion = data.pendingRectRegion;
+        data.maskRegion = data.rectRegion.isEmpty() ? data.region : data.region - data.rectRegion;
+        data.content = blurSurface ? blurSurface->mask() : nullptr;
+        data.maskDirty = false;
+    }
+
+    if (allocated) {
+        updatePeakMemoryUsage();
+    }
+    return changed;
+}
+
+void BlurNGEffect::startStagedUploads()
+{
+    bool contextCurrent = false;
+    for (auto &[w, data] : m_windows) {
+        if (!std::exchange(data.uploadStaged, false)) {
+            continue;
+        }
+        auto blurSurface = s_blurManager->surface(w->surface());
+        if (!blurSurface) {
+            continue;
+        }
+        if (!contextCurrent) {
+            effects->makeOpenGLContextCurrent();
+            contextCurrent = true;
+        }
+        blurSurface->uploadMasks(&m_maskUploader);
+    }
+
+    if (contextCurrent) {
+        updatePeakMemoryUsage();
+    }
+}
+
+void BlurNGEffect::evictIdleRenderData()
+{
+    if (m_renderDataIdleTimeout.count() == 0) {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    bool remaining = false;
+
+    effects->makeOpenGLContextCurrent();
+    for (auto &[window, data] : m_windows) {
+        for (auto it = data.render.begin(); it != data.render.end();) {
+            BlurNGRenderData &renderInfo = it->second;
+            if (now - renderInfo.lastUsed < m_renderDataIdleTimeout) {
+                remaining |= !renderInfo.textures.empty();
+                ++it;
+                continue;
+            }
+
+            if (!renderInfo.textures.empty()) {
+                renderInfo.originalFramebuffer.reset();
+                renderInfo.original.reset();
+                renderInfo.framebuffers.clear();
+                if (m_hibernateBackdrop && renderInfo.textures.size() > 1) {
+                    renderInfo.hibernatedBackdrop = std::move(renderInfo.textures.back());
+                    renderInfo.hibernatedRect = renderInfo.paddedRect;
+                }
+                renderInfo.textures.clear();
+            }
+
+            if (renderInfo.hibernatedBackdrop) {
+                ++it;
+            } else {
+                it = data.render.erase(it);
+            }
+        }
+    }
+
+    // Nothing may be painted anymore, check again for the render data that is still warm
+    if (remaining) {
+        m_evictionTimer.start(m_renderDataIdleTimeout);
+    }
+}
+
 void BlurNGEffect::slotWindowAdded(EffectWindow *w)
 {
     if (auto internal = w->internalWindow()) {
@@ -263,6 +503,7 @@ void BlurNGEffect::slotWindowAdded(EffectWindow *w)
 
 void BlurNGEffect::slotWindowDeleted(EffectWindow *w)
 {
+    m_paintCaches.erase(w);
     if (auto it = m_windows.find(w); it != m_windows.end()) {
         effects->makeOpenGLContextCurrent();
         m_windows.erase(it);
@@ -272,6 +513,13 @@ void BlurNGEffect::slotWindowDeleted(EffectWindow *w)
 void BlurNGEffect::slotScreenRemoved(KWin::Output *screen)
 {
     for (auto &[window, data] : m_windows) {
+        // The frame will never be presented
+        if (data.appliedOutput == screen) {
+            data.appliedOutput = nullptr;
+            if (auto blurSurface = s_blurManager->surface(window->surface())) {
+                blurSurface->sendApplied(steadyTime());
+            }
+        }
         if (auto it = data.render.find(screen); it != data.render.end()) {
             effects->makeOpenGLContextCurrent();
             data.render.erase(it);
@@ -337,56 +585,172 @@ bool BlurNGEffect::decorationSupportsBlurNGBehind(const EffectWindow *w) const
 
 void BlurNGEffect::prePaintScreen(ScreenPrePaintData &data, std::chrono::milliseconds presentTime)
 {
-    m_paintedArea = QRegion();
-    m_currentBlur = QRegion();
+    m_paintTracker.clear();
+    m_visibleAreasPending = true;
     m_currentScreen = effects->waylandDisplay() ? data.screen : nullptr;
 
+    if (!m_windows.empty()) {
+        // Linking the programs and uploading the masks run outside of the paint pass
+        effects->makeOpenGLContextCurrent();
+        ensurePrograms();
+        // Masks that became live in this frame repaint their old and new area
+        data.paint += resolveBlurMasks(m_currentScreen);
+    }
+
     effects->prePaintScreen(data, presentTime);
 }
 
-void BlurNGEffect::prePaintWindow(EffectWindow *w, WindowPrePaintData &data, std::chrono::milliseconds presentTime)
+void BlurNGEffect::postPaintScreen()
 {
-    // this effect relies on prePaintWindow being called in the bottom to top order
+    // Blur is skipped until the programs are linked, come back once they are
+    if (m_programState == ProgramState::Linking && !m_linkPollTimer.isActive()) {
+        m_linkPollTimer.start();
+    }
 
-    effects->prePaintWindow(w, data, presentTime);
+    // Pick up the mask uploads that are in flight in the next frame
+    if (!m_pendingUploadArea.isEmpty()) {
+        effects->addRepaint(std::exchange(m_pendingUploadArea, QRegion()));
+    }
 
-    const QRegion oldOpaque = data.opaque;
-    if (data.opaque.intersects(m_currentBlur)) {
-        // to blur an area partially we have to shrink the opaque area of a window
-        QRegion newOpaque;
-        for (const QRect &rect : data.opaque) {
-            newOpaque += rect.adjusted(m_expandSize, m_expandSize, -m_expandSize, -m_expandSize);
+    // Nothing was drawn, the feedback still looks at what is visible
+    if (std::exchange(m_visibleAreasPending, false)) {
+        m_paintTracker.updateVisibleAreas();
+    }
+    sendAppliedFeedback();
+
+    if (m_renderDataIdleTimeout.count() > 0 && !m_evictionTimer.isActive()) {
+        m_evictionTimer.start(m_renderDataIdleTimeout);
+    }
+
+    effects->postPaintScreen();
+}
+
+void BlurNGEffect::pollProgramLinking()
+{
+    if (m_programState != ProgramState::Linking) {
+        return;
+    }
+
+    effects->makeOpenGLContextCurrent();
+    if (!ensurePrograms()) {
+        if (m_programState == ProgramState::Linking) {
+            m_linkPollTimer.start();
         }
-        data.opaque = newOpaque;
+        return;
+    }
+
+    // Only the blurred areas were painted without blur, including what the blur samples from
+    QRegion area;
+    for (const auto &[w, data] : m_windows) {
+        const QRect blurArea = data.region.boundingRect().translated(w->pos().toPoint());
+        area += blurArea.adjusted(-m_expandSize, -m_expandSize, m_expandSize, m_expandSize);
+    }
+    effects->addRepaint(area);
+}
 
-        // we don't have to blur a region we don't see
-        m_currentBlur -= newOpaque;
+/**
+ * Whether the blur of the window is painted at all. Like their frame callbacks,
+ * windows that aren't shown don't wait for it.
+ */
+bool BlurNGEffect::canPresentBlur(const EffectWindow *w) const
+{
+    if (m_programState == ProgramState::Failed || w->isDesktop() || w->isMinimized() || !w->isOnCurrentDesktop()) {
+        return false;
     }
+    const QRectF geometry = w->frameGeometry();
+    const auto screens = effects->screens();
+    return std::any_of(screens.begin(), screens.end(), [&geometry](const Output *screen) {
+        return geometry.intersects(screen->geometry());
+    });
+}
 
-    // if we have to paint a non-opaque part of this window that intersects with the
-    // currently blurred region we have to redraw the whole region
-    if ((data.paint - oldOpaque).intersects(m_currentBlur)) {
-        data.paint += m_currentBlur;
+void BlurNGEffect::sendAppliedFeedback()
+{
+    for (auto &[w, data] : m_windows) {
+        if (!data.appliedPending) {
+            continue;
+        }
+        if (canPresentBlur(w)) {
+            // Masks that are still being uploaded aren't painted yet, windows on other screens are
+            // answered once their screen is painted
+            if (data.maskDirty) {
+                continue;
+            }
+            if (m_currentScreen && !w->frameGeometry().intersects(m_currentScreen->geometry())) {
+                continue;
+            }
+            // The blur is skipped while the programs are linked or the window is transformed,
+            // only blur that has nothing visible to paint doesn't need this frame
+            if (!data.blurPainted && !data.region.isEmpty() && !data.visibleArea.isEmpty()) {
+                continue;
+            }
+        } else {
+            if (auto blurSurface = s_blurManager->surface(w->surface())) {
+                blurSurface->sendApplied(steadyTime());
+            }
+            data.appliedPending = false;
+            continue;
+        }
+
+        data.appliedPending = false;
+        if (m_currentScreen) {
+            // Answered with the time the frame actually reaches the screen
+            data.appliedOutput = m_currentScreen;
+            connect(m_currentScreen->renderLoop(), &RenderLoop::framePresented, this, &BlurNGEffect::sendPresentedFeedback, Qt::UniqueConnection);
+        } else if (auto blurSurface = s_blurManager->surface(w->surface())) {
+            blurSurface->sendApplied(steadyTime());
+        }
     }
 
-    // in case this window has regions to be blurred
-    const QRegion blurArea = blurRegion(w).boundingRect().translated(w->pos().toPoint());
+    for (auto &[w, data] : m_windows) {
+        data.blurPainted = false;
+    }
+}
 
-    // if this window or a window underneath the blurred area is painted again we have to
-    // blur everything
-    if (m_paintedArea.intersects(blurArea) || data.paint.intersects(blurArea)) {
-        data.paint += blurArea;
-        // we have to check again whether we do not damage a blurred area
-        // of a window
-        if (blurArea.intersects(m_currentBlur)) {
-            data.paint += m_currentBlur;
+void BlurNGEffect::sendPresentedFeedback(RenderLoop *loop, std::chrono::nanoseconds timestamp)
+{
+    for (auto &[w, data] : m_windows) {
+        if (!data.appliedOutput || data.appliedOutput->renderLoop() != loop) {
+            continue;
         }
+        data.appliedOutput = nullptr;
+        if (auto blurSurface = s_blurManager->surface(w->surface())) {
+            blurSurface->sendApplied(std::chrono::duration_cast<std::chrono::milliseconds>(timestamp));
+        }
+    }
+}
+
+void BlurNGEffect::prePaintWindow(EffectWindow *w, WindowPrePaintData &data, std::chrono::milliseconds presentTime)
+{
+    // this effect relies on prePaintWindow being called in the bottom to top order
+
+    effects->prePaintWindow(w, data, presentTime);
+
+    auto it = m_windows.find(w);
+    if (it == m_windows.end()) {
+        m_paintTracker.addWindow(data.paint, data.opaque, m_paintCaches[w], nullptr);
+        return;
     }
 
-    m_currentBlur += blurArea;
+    BlurNGEffectData &blurInfo = it->second;
+    // in case this window has regions to be blurred
+    const QRect blurArea = blurInfo.region.boundingRect().translated(w->pos().toPoint());
+    if (blurArea.isEmpty()) {
+        blurInfo.visibleArea = QRegion();
+        m_paintTracker.addWindow(data.paint, data.opaque, m_paintCaches[w], nullptr);
+        return;
+    }
 
-    m_paintedArea -= data.opaque;
-    m_paintedArea += data.paint;
+    const auto renderIt = blurInfo.render.find(m_currentScreen);
+    const BlurNGPaintTracker::BlurredWindow blurred{
+        .area = blurArea,
+        .cached = blurInfo.lastBackgroundRect == blurArea && renderIt != blurInfo.render.end() && !renderIt->second.textures.empty(),
+        .visibleArea = &blurInfo.visibleArea,
+    };
+    // Without render data for this screen the background is blurred from scratch anyway
+    if (m_paintTracker.addWindow(data.paint, data.opaque, m_paintCaches[w], &blurred) && renderIt != blurInfo.render.end()) {
+        renderIt->second.backgroundDirty = true;
+    }
 }
 
 bool BlurNGEffect::shouldBlur(const EffectWindow *w, int mask, const WindowPaintData &data) const
@@ -411,6 +775,10 @@ bool BlurNGEffect::shouldBlur(const EffectWindow *w, int mask, const WindowPaint
 
 void BlurNGEffect::drawWindow(const RenderTarget &renderTarget, const RenderViewport &viewport, EffectWindow *w, int mask, const QRegion &region, WindowPaintData &data)
 {
+    // Every window is through prePaintWindow() once the first one is drawn
+    if (std::exchange(m_visibleAreasPending, false)) {
+        m_paintTracker.updateVisibleAreas();
+    }
     blur(renderTarget, viewport, w, mask, region, data);
 
     // Draw the window over the blurred area
@@ -448,15 +816,40 @@ GLTexture *BlurNGEffect::ensureNoiseTexture()
         m_noisePass.noiseTexture->setWrapMode(GL_REPEAT);
         m_noisePass.noiseTextureScale = scale;
         m_noisePass.noiseTextureStength = m_noiseStrength;
+        updatePeakMemoryUsage();
     }
 
     return m_noisePass.noiseTexture.get();
 }
 
+/**
+ * The format of the downsampled levels. Only the first texture needs the precision of the
+ * render target, it's mixed with the blurred result at the edges of the mask. The blurred
+ * levels are low frequency by nature and the alpha channel of the background is unused, so
+ * a packed float format is enough for them and halves their bandwidth on FP16 outputs.
+ */
+static GLenum intermediateTextureFormat(GLenum textureFormat, bool reducedPrecision)
+{
+    if (!reducedPrecision || textureFormat != GL_RGBA16F) {
+        return textureFormat;
+    }
+
+    const auto context = OpenGlContext::currentContext();
+    const bool renderable = context->isOpenGLES()
+        ? context->hasVersion(Version(3, 2)) || context->hasOpenglExtension(QByteArrayLiteral("GL_EXT_color_buffer_float"))
+        : context->hasVersion(Version(3, 0));
+    return renderable ? GL_R11F_G11F_B10F : textureFormat;
+}
+
 void BlurNGEffect::blur(const RenderTarget &renderTarget, const RenderViewport &viewport, EffectWindow *w, int mask, const QRegion &region, WindowPaintData &data)
 {
+    if (m_programState != ProgramState::Ready) {
+        return;
+    }
+
     auto it = m_windows.find(w);
-    if (it == m_windows.end() || !it->second.content) {
+    // Rect regions are blurred without a mask texture
+    if (it == m_windows.end() || (!it->second.content && it->second.rectRegion.isEmpty())) {
         return;
     }
 
@@ -466,73 +859,156 @@ void BlurNGEffect::blur(const RenderTarget &renderTarget, const RenderViewport &
         return;
     }
 
+    // Occlusion was computed in prePaintWindow() on the untransformed blur area
+    const bool transformed = (mask & PAINT_WINDOW_TRANSFORMED) || data.xTranslation() || data.yTranslation()
+        || data.xScale() != 1 || data.yScale() != 1;
+    // Nothing would be left to see, the background stays dirty until the window is uncovered
+    if (!transformed && blurInfo.visibleArea.isEmpty()) {
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    renderInfo.lastUsed = now;
+
     // Compute the effective blur shape. Note that if the window is transformed, so will be the blur shape.
-    QRegion blurShape = blurRegion(w).translated(w->pos().toPoint());
-    if (data.xScale() != 1 || data.yScale() != 1) {
-        QPoint pt = blurShape.boundingRect().topLeft();
-        QRegion scaledShape;
-        for (const QRect &r : blurShape) {
-            const QPointF topLeft(pt.x() + (r.x() - pt.x()) * data.xScale() + data.xTranslation(),
-                                  pt.y() + (r.y() - pt.y()) * data.yScale() + data.yTranslation());
-            const QPoint bottomRight(std::floor(topLeft.x() + r.width() * data.xScale()) - 1,
-                                     std::floor(topLeft.y() + r.height() * data.yScale()) - 1);
-            scaledShape += QRect(QPoint(std::floor(topLeft.x()), std::floor(topLeft.y())), bottomRight);
-        }
-        blurShape = scaledShape;
-    } else if (data.xTranslation() || data.yTranslation()) {
-        blurShape.translate(std::round(data.xTranslation()), std::round(data.yTranslation()));
-    }
-
-    const QRect backgroundRect = blurShape.boundingRect();
+    // The regions are walked with an offset instead of being copied, this runs for every blurred window in
+    // every frame. The shape is painted in two parts, through the mask and, for rect regions, without it.
+    QPoint shapeOffset = w->pos().toPoint();
+    QRect backgroundRect;
+    const bool scaled = data.xScale() != 1 || data.yScale() != 1;
+    if (scaled) {
+        const QPoint pt = blurInfo.region.boundingRect().translated(shapeOffset).topLeft();
+        const auto scaleShape = [&](const QRegion &shape, std::vector<QRect> &scaledShape) {
+            scaledShape.clear();
+            for (const QRect &shapeRect : shape) {
+                const QRect r = shapeRect.translated(shapeOffset);
+                const QPointF topLeft(pt.x() + (r.x() - pt.x()) * data.xScale() + data.xTranslation(),
+                                      pt.y() + (r.y() - pt.y()) * data.yScale() + data.yTranslation());
+                const QPoint bottomRight(std::floor(topLeft.x() + r.width() * data.xScale()) - 1,
+                                         std::floor(topLeft.y() + r.height() * data.yScale()) - 1);
+                const QRect scaledShapeRect(QPoint(std::floor(topLeft.x()), std::floor(topLeft.y())), bottomRight);
+                scaledShape.push_back(scaledShapeRect);
+                backgroundRect |= scaledShapeRect;
+            }
+        };
+        scaleShape(blurInfo.maskRegion, m_scaledMaskShape);
+        scaleShape(blurInfo.rectRegion, m_scaledRectShape);
+        shapeOffset = QPoint();
+    } else {
+        if (data.xTranslation() || data.yTranslation()) {
+            shapeOffset += QPoint(std::round(data.xTranslation()), std::round(data.yTranslation()));
+        }
+        backgroundRect = blurInfo.region.boundingRect().translated(shapeOffset);
+    }
+
     const QRect deviceBackgroundRect = snapToPixelGrid(scaledRect(backgroundRect, viewport.scale()));
+    // The textures only cover what this output shows of the background, plus the surroundings
+    // the blur samples from. Every output keeps its own chain, parts on other outputs or off
+    // screen would only cost memory and fill rate.
+    const QRect paddedRect = backgroundRect.adjusted(-m_expandSize, -m_expandSize, m_expandSize, m_expandSize)
+                                 .intersected(viewport.renderRect().toRect());
+    if (!paddedRect.intersects(backgroundRect)) {
+        return;
+    }
+    const QRect devicePaddedRect = snapToPixelGrid(scaledRect(paddedRect, viewport.scale()));
     // const auto opacity = w->opacity() * data.opacity();
     const auto opacity = 0.99;
 
+    // Only clip to the visible area if a window above actually covers some of it
+    const bool clipToVisible = !transformed && !(blurInfo.visibleArea.rectCount() == 1 && *blurInfo.visibleArea.begin() == backgroundRect);
+
     // Get the effective shape that will be actually blurred. It's possible that all of it will be clipped.
-    QList<QRectF> effectiveShape;
-    effectiveShape.reserve(blurShape.rectCount());
-    if (region != infiniteRegion()) {
-        for (const QRect &clipRect : region) {
-            const QRectF deviceClipRect = snapToPixelGridF(scaledRect(clipRect, viewport.scale()))
-                                              .translated(-deviceBackgroundRect.topLeft());
-            for (const QRect &shapeRect : blurShape) {
-                const QRectF deviceShapeRect = snapToPixelGridF(scaledRect(shapeRect.translated(-backgroundRect.topLeft()), viewport.scale()));
-                if (const QRectF intersected = deviceClipRect.intersected(deviceShapeRect); !intersected.isEmpty()) {
-                    effectiveShape.append(intersected);
-                }
-            }
+    QList<QRectF> &effectiveShape = m_effectiveShape;
+    effectiveShape.clear();
+    effectiveShape.reserve(blurInfo.maskRegion.rectCount() + blurInfo.rectRegion.rectCount());
+    const BlurNGShapeClip clip{
+        .paintRegion = region,
+        .visibleArea = blurInfo.visibleArea,
+        .clipToVisible = clipToVisible,
+        .shapeToBackground = shapeOffset - backgroundRect.topLeft(),
+        .deviceBackgroundRect = deviceBackgroundRect,
+        .scale = viewport.scale(),
+    };
+    // Masks that aren't uploaded yet leave only the rects to blur
+    if (blurInfo.content) {
+        if (scaled) {
+            appendBlurShape(effectiveShape, clip, m_scaledMaskShape);
+        } else {
+            appendBlurShape(effectiveShape, clip, std::span(blurInfo.maskRegion.begin(), blurInfo.maskRegion.end()));
         }
+    }
+    const int maskVertexCount = effectiveShape.size() * 6;
+    if (scaled) {
+        appendBlurShape(effectiveShape, clip, m_scaledRectShape);
     } else {
-        for (const QRect &rect : blurShape) {
-            effectiveShape.append(snapToPixelGridF(scaledRect(rect.translated(-backgroundRect.topLeft()), viewport.scale())));
-        }
+        appendBlurShape(effectiveShape, clip, std::span(blurInfo.rectRegion.begin(), blurInfo.rectRegion.end()));
     }
     if (effectiveShape.isEmpty()) {
         return;
     }
 
-    bool shouldBlur = false;
-
-    if ((blurInfo.frameIndex == 0) || (blurInfo.lastBackgroundRect != backgroundRect)) {
-        shouldBlur = true;
+    if (blurInfo.lastBackgroundRect != backgroundRect) {
         blurInfo.lastBackgroundRect = backgroundRect;
+        for (auto &[output, info] : blurInfo.render) {
+            info.backgroundDirty = true;
+        }
     }
 
-    blurInfo.frameIndex = (blurInfo.frameIndex + 1) % m_blurUpdateInterval;
+    // Re-blur when the background changed, but at most once per m_maxStaleness. In between
+    // only the unblurred copy follows the damage and a repaint is scheduled for later.
+    bool shouldBlur = false;
+    if (renderInfo.backgroundDirty) {
+        const auto sinceBlurred = now - renderInfo.lastBlurred;
+        if (sinceBlurred >= m_maxStaleness) {
+            shouldBlur = true;
+        } else {
+            const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(m_maxStaleness - sinceBlurred);
+            m_deferredArea.add(paddedRect);
+            if (!m_reblurTimer.isActive() || m_reblurTimer.remainingTimeAsDuration() > remaining) {
+                m_reblurTimer.start(remaining);
+            }
+        }
+    }
 
     // Maybe reallocate offscreen render targets. Keep in mind that the first one contains
-    // original background behind the window, it's not blurred.
+    // original background behind the window at the working scale, it's not blurred.
     GLenum textureFormat = GL_RGBA8;
     if (renderTarget.texture()) {
         textureFormat = renderTarget.texture()->internalFormat();
     }
 
-    if (renderInfo.framebuffers.size() != (m_iterationCount + 1) || renderInfo.textures[0]->size() != backgroundRect.size() || renderInfo.textures[0]->internalFormat() != textureFormat) {
+    const GLenum intermediateFormat = intermediateTextureFormat(textureFormat, m_reducedPrecisionChain);
+
+    const QSize workingSize = (QSizeF(paddedRect.size()) * m_workingScale).toSize().expandedTo(QSize(1, 1));
+    const bool keepOriginal = m_workingScale < 1.0;
+
+    if (renderInfo.framebuffers.size() != (m_iterationCount + 1) || renderInfo.textures[0]->size() != workingSize || renderInfo.textures[0]->internalFormat() != textureFormat
+        || renderInfo.textures[1]->internalFormat() != intermediateFormat
+        || (keepOriginal ? !renderInfo.original || renderInfo.original->size() != paddedRect.size() : bool(renderInfo.original))) {
         renderInfo.framebuffers.clear();
         renderInfo.textures.clear();
+        renderInfo.originalFramebuffer.reset();
+        renderInfo.original.reset();
+
+        if (keepOriginal) {
+            renderInfo.original = GLTexture::allocate(textureFormat, paddedRect.size());
+            if (!renderInfo.original) {
+                qCWarning(KWIN_BLUR) << "Failed to allocate an offscreen texture";
+                return;
+            }
+            renderInfo.original->setFilter(GL_LINEAR);
+            renderInfo.original->setWrapMode(GL_CLAMP_TO_EDGE);
+
+            renderInfo.originalFramebuffer = std::make_unique<GLFramebuffer>(renderInfo.original.get());
+            if (!renderInfo.originalFramebuffer->valid()) {
+                qCWarning(KWIN_BLUR) << "Failed to create an offscreen framebuffer";
+                renderInfo.originalFramebuffer.reset();
+                renderInfo.original.reset();
+                return;
+            }
+        }
 
         for (size_t i = 0; i <= m_iterationCount; ++i) {
-            auto texture = GLTexture::allocate(textureFormat, backgroundRect.size() / (1 << i));
+            auto texture = GLTexture::allocate(i == 0 ? textureFormat : intermediateFormat, workingSize / (1 << i));
             if (!texture) {
                 qCWarning(KWIN_BLUR) << "Failed to allocate an offscreen texture";
                 return;
@@ -548,15 +1024,51 @@ void BlurNGEffect::blur(const RenderTarget &renderTarget, const RenderViewport &
             renderInfo.textures.push_back(std::move(texture));
             renderInfo.framebuffers.push_back(std::move(framebuffer));
         }
+        // The hibernated backdrop is still alive at this point
+        updatePeakMemoryUsage();
+
+        // The window was evicted while idle, start from its downscaled background so that
+        // the parts which are not repainted in this frame don't show uninitialized pixels.
+        if (renderInfo.hibernatedBackdrop) {
+            if (renderInfo.hibernatedRect == paddedRect) {
+                ShaderBinder binder(ShaderTrait::MapTexture);
+                QMatrix4x4 projectionMatrix;
+                projectionMatrix.ortho(QRectF(QPointF(0, 0), paddedRect.size()));
+                binder.shader()->setUniform(GLShader::Mat4Uniform::ModelViewProjectionMatrix, projectionMatrix);
+                for (GLFramebuffer *framebuffer : {renderInfo.framebuffers[0].get(), renderInfo.originalFramebuffer.get()}) {
+                    if (!framebuffer) {
+                        continue;
+                    }
+                    GLFramebuffer::pushFramebuffer(framebuffer);
+                    renderInfo.hibernatedBackdrop->render(paddedRect.size());
+                    GLFramebuffer::popFramebuffer();
+                }
+            }
+            renderInfo.hibernatedBackdrop.reset();
+        }
 
         shouldBlur = true;
     }
-
-    if (shouldBlur) {
-        // Fetch the pixels behind the shape that is going to be blurred.
-        const QRegion dirtyRegion = region & backgroundRect;
-        for (const QRect &dirtyRect : dirtyRegion) {
-            renderInfo.framebuffers[0]->blitFromRenderTarget(renderTarget, viewport, dirtyRect, dirtyRect.translated(-backgroundRect.topLeft()));
+    renderInfo.paddedRect = paddedRect;
+
+    if (shouldBlur || renderInfo.backgroundDirty) {
+        // Fetch the pixels behind the shape that is going to be blurred. Without a full
+        // resolution copy the blit downscales straight to the working resolution.
+        for (const QRect &paintRect : region) {
+            const QRect dirtyRect = paintRect & paddedRect;
+            if (dirtyRect.isEmpty()) {
+                continue;
+            }
+            const QRect localRect = dirtyRect.translated(-paddedRect.topLeft());
+            const QRect destination = snapToPixelGrid(scaledRect(localRect, m_workingScale));
+            if (renderInfo.originalFramebuffer) {
+                renderInfo.originalFramebuffer->blitFromRenderTarget(renderTarget, viewport, dirtyRect, localRect);
+                GLFramebuffer::pushFramebuffer(renderInfo.originalFramebuffer.get());
+                renderInfo.framebuffers[0]->blitFromFramebuffer(localRect, destination, GL_LINEAR);
+                GLFramebuffer::popFramebuffer();
+            } else {
+                renderInfo.framebuffers[0]->blitFromRenderTarget(renderTarget, viewport, dirtyRect, destination);
+            }
         }
     }
 
@@ -574,17 +1086,17 @@ void BlurNGEffect::blur(const RenderTarget &renderTarget, const RenderViewport &
 
         // The geometry that will be blurred offscreen, in logical pixels.
         {
-            const QRectF localRect = QRectF(0, 0, backgroundRect.width(), backgroundRect.height());
+            const QRectF localRect = QRectF(0, 0, paddedRect.width(), paddedRect.height());
 
             const float x0 = localRect.left();
             const float y0 = localRect.top();
             const float x1 = localRect.right();
             const float y1 = localRect.bottom();
 
-            const float u0 = x0 / backgroundRect.width();
-            const float v0 = 1.0f - y0 / backgroundRect.height();
-            const float u1 = x1 / backgroundRect.width();
-            const float v1 = 1.0f - y1 / backgroundRect.height();
+            const float u0 = x0 / paddedRect.width();
+            const float v0 = 1.0f - y0 / paddedRect.height();
+            const float u1 = x1 / paddedRect.width();
+            const float v1 = 1.0f - y1 / paddedRect.height();
 
             // first triangle
             map[vboIndex++] = GLVertex2D{
@@ -664,12 +1176,17 @@ void BlurNGEffect::blur(const RenderTarget &renderTarget, const RenderViewport &
 
     vbo->bindArrays();
 
+    if (shouldBlur) {
+        renderInfo.backgroundDirty = false;
+        renderInfo.lastBlurred = now;
+    }
+
     // The downsample pass of the dual Kawase algorithm: the background will be scaled down 50% every iteration.
     if (shouldBlur) {
-        ShaderManager::instance()->pushShader(m_downsamplePass.shader.get());
+        ShaderBinder binder(m_downsamplePass.shader.get());
 
         QMatrix4x4 projectionMatrix;
-        projectionMatrix.ortho(QRectF(0.0, 0.0, backgroundRect.width(), backgroundRect.height()));
+        projectionMatrix.ortho(QRectF(0.0, 0.0, paddedRect.width(), paddedRect.height()));
 
         m_downsamplePass.shader->setUniform(m_downsamplePass.mvpMatrixLocation, projectionMatrix);
         m_downsamplePass.shader->setUniform(m_downsamplePass.offsetLocation, float(m_offset));
@@ -687,22 +1204,20 @@ void BlurNGEffect::blur(const RenderTarget &renderTarget, const RenderViewport &
             GLFramebuffer::pushFramebuffer(draw.get());
             vbo->draw(GL_TRIANGLES, 0, 6);
         }
-
-        ShaderManager::instance()->popShader();
     }
 
     // The upsample pass of the dual Kawase algorithm: the background will be scaled up 200% every iteration.
     {
-        ShaderManager::instance()->pushShader(m_upsamplePass.shader.get());
+        ShaderBinder binder(m_upsamplePass.shader.get());
 
         QMatrix4x4 projectionMatrix;
-        projectionMatrix.ortho(QRectF(0.0, 0.0, backgroundRect.width(), backgroundRect.height()));
+        projectionMatrix.ortho(QRectF(0.0, 0.0, paddedRect.width(), paddedRect.height()));
 
         m_upsamplePass.shader->setUniform(m_upsamplePass.mvpMatrixLocation, projectionMatrix);
         m_upsamplePass.shader->setUniform(m_upsamplePass.offsetLocation, float(m_offset));
-        m_upsamplePass.shader->setUniform("alphaMask", 1);
-        m_upsamplePass.shader->setUniform("original", 2);
-        m_upsamplePass.shader->setUniform("finalRound", false);
+        m_upsamplePass.shader->setUniform(m_upsamplePass.alphaMaskLocation, 1);
+        m_upsamplePass.shader->setUniform(m_upsamplePass.originalLocation, 2);
+        m_upsamplePass.shader->setUniform(m_upsamplePass.finalRoundLocation, false);
 
         if (shouldBlur) {
             for (size_t i = renderInfo.framebuffers.size() - 1; i > 1; --i) {
@@ -726,19 +1241,30 @@ void BlurNGEffect::blur(const RenderTarget &renderTarget, const RenderViewport &
 
         projectionMatrix = viewport.projectionMatrix();
         projectionMatrix.translate(deviceBackgroundRect.x(), deviceBackgroundRect.y());
-        m_upsamplePass.shader->setUniform("finalRound", true);
+        m_upsamplePass.shader->setUniform(m_upsamplePass.finalRoundLocation, true);
         m_upsamplePass.shader->setUniform(m_upsamplePass.mvpMatrixLocation, projectionMatrix);
 
+        // The vertices carry the coordinates of the mask, which covers only the blurred area
+        const QVector2D backgroundScale(float(deviceBackgroundRect.width()) / devicePaddedRect.width(),
+                                        float(deviceBackgroundRect.height()) / devicePaddedRect.height());
+        const QVector2D backgroundOffset(float(deviceBackgroundRect.x() - devicePaddedRect.x()) / devicePaddedRect.width(),
+                                         1.0f - float(deviceBackgroundRect.bottom() + 1 - devicePaddedRect.y()) / devicePaddedRect.height());
+        m_upsamplePass.shader->setUniform(m_upsamplePass.backgroundScaleLocation, backgroundScale);
+        m_upsamplePass.shader->setUniform(m_upsamplePass.backgroundOffsetLocation, backgroundOffset);
+
         const QVector2D halfpixel(0.5 / read->colorAttachment()->width(),
                                   0.5 / read->colorAttachment()->height());
         m_upsamplePass.shader->setUniform(m_upsamplePass.halfpixelLocation, halfpixel);
 
         glActiveTexture(GL_TEXTURE0);
         read->colorAttachment()->bind();
-        glActiveTexture(GL_TEXTURE1);
-        it->second.content->bind();
-        glActiveTexture(GL_TEXTURE2);
-        renderInfo.textures[0]->bind();
+        if (maskVertexCount > 0) {
+            glActiveTexture(GL_TEXTURE1);
+            it->second.content->bind();
+            glActiveTexture(GL_TEXTURE2);
+            (renderInfo.original ? renderInfo.original : renderInfo.textures[0])->bind();
+            glActiveTexture(GL_TEXTURE0);
+        }
 
         // Modulate the blurred texture with the window opacity if the window isn't opaque
         if (opacity < 1.0) {
@@ -749,14 +1275,27 @@ void BlurNGEffect::blur(const RenderTarget &renderTarget, const RenderViewport &
             glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
         }
 
-        vbo->draw(GL_TRIANGLES, 6, vertexCount);
+        if (maskVertexCount > 0) {
+            vbo->draw(GL_TRIANGLES, 6, maskVertexCount);
+        }
+
+        // Rect regions are blurred fully, neither the mask nor the original background is sampled
+        if (vertexCount > maskVertexCount) {
+            ShaderBinder rectBinder(m_upsampleRectPass.shader.get());
+            m_upsampleRectPass.shader->setUniform(m_upsampleRectPass.mvpMatrixLocation, projectionMatrix);
+            m_upsampleRectPass.shader->setUniform(m_upsampleRectPass.offsetLocation, float(m_offset));
+            m_upsampleRectPass.shader->setUniform(m_upsampleRectPass.halfpixelLocation, halfpixel);
+            m_upsampleRectPass.shader->setUniform(m_upsampleRectPass.backgroundScaleLocation, backgroundScale);
+            m_upsampleRectPass.shader->setUniform(m_upsampleRectPass.backgroundOffsetLocation, backgroundOffset);
+
+            vbo->draw(GL_TRIANGLES, 6 + maskVertexCount, vertexCount - maskVertexCount);
+        }
 
         if (opacity < 1.0) {
             glDisable(GL_BLEND);
         }
-
-        ShaderManager::instance()->popShader();
     }
+    blurInfo.blurPainted = true;
 
     // qWarning() << "NOISEppp!!" << m_noiseStrength;
     // if (m_noiseStrength > 0) {
@@ -771,7 +1310,7 @@ void BlurNGEffect::blur(const RenderTarget &renderTarget, const RenderViewport &
     //     }
     //
     //     if (GLTexture *noiseTexture = ensureNoiseTexture()) {
-    //         ShaderManager::instance()->pushShader(m_noisePass.shader.get());
+    //         ShaderBinder binder(m_noisePass.shader.get());
     //
     //         QMatrix4x4 projectionMatrix = viewport.projectionMatrix();
     //         projectionMatrix.translate(deviceBackgroundRect.x(), deviceBackgroundRect.y());
@@ -783,8 +1322,6 @@ void BlurNGEffect::blur(const RenderTarget &renderTarget, const RenderViewport &
     //         noiseTexture->bind();
     //
     //         vbo->draw(GL_TRIANGLES, 6, vertexCount);
-    //
-    //         ShaderManager::instance()->popShader();
     //     }
     //
     //     glDisable(GL_BLEND);
@@ -803,6 +1340,177 @@ bool BlurNGEffect::blocksDirectScanout() const
     return false;
 }
 
+static qint64 renderDataMemoryUsage(const BlurNGRenderData &renderInfo)
+{
+    qint64 usage = textureMemoryUsage(renderInfo.hibernatedBackdrop.get()) + textureMemoryUsage(renderInfo.original.get());
+    for (const auto &texture : renderInfo.textures) {
+        usage += textureMemoryUsage(texture.get());
+    }
+    return usage;
+}
+
+qint64 BlurNGEffect::windowMaskMemoryUsage(EffectWindow *w) const
+{
+    if (!s_blurManager || !w->surface()) {
+        return 0;
+    }
+    auto blurSurface = s_blurManager->surface(w->surface());
+    return blurSurface ? blurSurface->memoryUsage() : 0;
+}
+
+qint64 BlurNGEffect::renderMemoryUsage() const
+{
+    qint64 usage = textureMemoryUsage(m_noisePass.noiseTexture.get());
+    for (const auto &[window, data] : m_windows) {
+        for (const auto &[output, renderInfo] : data.render) {
+            usage += renderDataMemoryUsage(renderInfo);
+        }
+    }
+    return usage;
+}
+
+qint64 BlurNGEffect::maskMemoryUsage() const
+{
+    qint64 usage = 0;
+    for (const auto &[window, data] : m_windows) {
+        usage += windowMaskMemoryUsage(window);
+    }
+    return usage;
+}
+
+void BlurNGEffect::updatePeakMemoryUsage()
+{
+    // Only called when textures are allocated, the usage can't grow in between
+    m_peakMemoryUsage = std::max(m_peakMemoryUsage, renderMemoryUsage() + maskMemoryUsage());
+}
+
+qint64 BlurNGEffect::peakMemoryUsage() const
+{
+    return std::max(m_peakMemoryUsage, renderMemoryUsage() + maskMemoryUsage());
+}
+
+quint32 BlurNGEffect::maskCount() const
+{
+    quint32 count = 0;
+    if (s_blurManager) {
+        const auto usage = s_blurManager->clientUsage();
+        for (const BlurNGClientUsage &client : usage) {
+            count += client.masks;
+        }
+    }
+    return count;
+}
+
+qint64 BlurNGEffect::maskPixels() const
+{
+    qint64 pixels = 0;
+    if (s_blurManager) {
+        const auto usage = s_blurManager->clientUsage();
+        for (const BlurNGClientUsage &client : usage) {
+            pixels += client.pixels;
+        }
+    }
+    return pixels;
+}
+
+quint64 BlurNGEffect::maskLimitViolations() const
+{
+    return s_blurManager ? s_blurManager->limitViolations() : 0;
+}
+
+QVariantList BlurNGEffect::maskBudgets() const
+{
+    QVariantList budgets;
+    if (!s_blurManager) {
+        return budgets;
+    }
+    const auto usage = s_blurManager->clientUsage();
+    for (const BlurNGClientUsage &client : usage) {
+        budgets.append(QVariantMap{
+            {QStringLiteral("executable"), client.client ? client.client->executablePath() : QString()},
+            {QStringLiteral("pid"), client.client ? client.client->processId() : 0},
+            {QStringLiteral("masks"), client.masks},
+            {QStringLiteral("pixels"), client.pixels},
+            {QStringLiteral("textureMemory"), client.textureMemory},
+        });
+    }
+    return budgets;
+}
+
+QString BlurNGEffect::debug(const QString &parameter) const
+{
+    if (parameter != QLatin1String("memory")) {
+        return QStringLiteral("Unknown parameter, supported: memory");
+    }
+
+    QMap<QString, qint64> outputs;
+    QMap<QString, qint64> clients;
+    QStringList windows;
+    qint64 renderTotal = 0;
+    qint64 maskTotal = 0;
+
+    for (const auto &[window, data] : m_windows) {
+        qint64 render = 0;
+        for (const auto &[output, renderInfo] : data.render) {
+            const qint64 usage = renderDataMemoryUsage(renderInfo);
+            // Without Wayland there is a single render target for all outputs
+            outputs[output ? output->name() : QStringLiteral("all outputs")] += usage;
+            render += usage;
+        }
+        const qint64 masks = windowMaskMemoryUsage(window);
+
+        QString client = QStringLiteral("unknown");
+        if (window->surface() && window->surface()->client()) {
+            const ClientConnection *connection = window->surface()->client();
+            client = QStringLiteral("%1 (pid %2)").arg(connection->executablePath()).arg(connection->processId());
+        }
+        clients[client] += render + masks;
+
+        windows << QStringLiteral("  %1 [%2]: render %3, masks %4").arg(window->caption(), window->windowClass()).arg(render).arg(masks);
+        renderTotal += render;
+        maskTotal += masks;
+    }
+
+    const qint64 noise = textureMemoryUsage(m_noisePass.noiseTexture.get());
+
+    QStringList report;
+    report << QStringLiteral("Total: %1 bytes (render %2, masks %3, noise %4), peak %5 bytes")
+                  .arg(renderTotal + maskTotal + noise)
+                  .arg(renderTotal)
+                  .arg(maskTotal)
+                  .arg(noise)
+                  .arg(peakMemoryUsage());
+    report << QStringLiteral("Outputs:");
+    for (auto it = outputs.cbegin(); it != outputs.cend(); ++it) {
+        report << QStringLiteral("  %1: %2").arg(it.key()).arg(it.value());
+    }
+    report << QStringLiteral("Clients:");
+    for (auto it = clients.cbegin(); it != clients.cend(); ++it) {
+        report << QStringLiteral("  %1: %2").arg(it.key()).arg(it.value());
+    }
+    report << QStringLiteral("Windows:");
+    report << windows;
+
+    if (s_blurManager) {
+        const BlurNGClientLimits limits = s_blurManager->clientLimits();
+        report << QStringLiteral("Mask budgets (limits: %1 masks, %2 pixels, %3 bytes, 0 is unlimited, %4 violations):")
+                      .arg(limits.maxMasks)
+                      .arg(limits.maxPixels)
+                      .arg(limits.maxTextureMemory)
+                      .arg(maskLimitViolations());
+        const auto usage = s_blurManager->clientUsage();
+        for (const BlurNGClientUsage &client : usage) {
+            report << QStringLiteral("  %1 (pid %2): %3 masks, %4 pixels, %5 bytes")
+                          .arg(client.client ? client.client->executablePath() : QStringLiteral("unknown"))
+                          .arg(client.client ? client.client->processId() : 0)
+                          .arg(client.masks)
+                          .arg(client.pixels)
+                          .arg(client.textureMemory);
+        }
+    }
+    return report.join(QLatin1Char('\n'));
+}
+
 } // namespace KWin
 
 #include "moc_blur.cpp"
@@ -8,17 +8,25 @@
 
 #pragma once
 
+#include "blurmaskuploader.h"
+#include "blurpainttracker.h"
+#include "blurprogram.h"
+
 #include <effect/effect.h>
 #include <opengl/glutils.h>
 #include <core/graphicsbuffer.h>
 
 #include <QList>
+#include <QTimer>
+#include <QVariant>
 
+#include <chrono>
 #include <unordered_map>
 
 namespace KWin
 {
 class BlurNGManagerInterface;
+class RenderLoop;
 
 struct BlurNGRenderData
 {
@@ -26,6 +34,24 @@ struct BlurNGRenderData
     /// contains not blurred background behind the window, it's cached.
     std::vector<std::unique_ptr<GLTexture>> textures;
     std::vector<std::unique_ptr<GLFramebuffer>> framebuffers;
+    /// The area of the background the textures cover, clipped to the output
+    QRect paddedRect;
+
+    /// The background at full resolution, only kept with a working scale below 1. The final
+    /// pass samples it next to the masks, the downscaled first texture would blur their edges.
+    std::unique_ptr<GLTexture> original;
+    std::unique_ptr<GLFramebuffer> originalFramebuffer;
+
+    /// The last level of the chain, kept when the render targets are evicted. It seeds
+    /// the background once the window is painted again.
+    std::unique_ptr<GLTexture> hibernatedBackdrop;
+    QRect hibernatedRect;
+
+    std::chrono::steady_clock::time_point lastUsed;
+
+    /// Something was painted behind the window since the chain was last blurred
+    bool backgroundDirty = true;
+    std::chrono::steady_clock::time_point lastBlurred;
 };
 
 struct BlurNGEffectData
@@ -35,10 +61,31 @@ struct BlurNGEffectData
 
     /// area covered by either masks
     QRegion region;
+    /// The part of region that is blurred fully without sampling content, and the rest
+    QRegion rectRegion;
+    QRegion maskRegion;
+
+    /// The regions as of the last commit, they replace the ones above together with the masks
+    QRegion pendingRegion;
+    QRegion pendingRectRegion;
+
+    /// The masks changed and content has to be fetched again before painting
+    bool maskDirty = true;
+    /// A commit changed the masks, their uploads start with the next m_uploadTimer
+    bool uploadStaged = false;
+
+    /// The client waits for the committed masks to be presented
+    bool appliedPending = false;
+    /// The masks were painted on this output, the client waits for the frame to be presented
+    Output *appliedOutput = nullptr;
+    /// The blur was painted in the current frame
+    bool blurPainted = false;
 
-    uint frameIndex = 0;
     QRect lastBackgroundRect;
 
+    /// The part of the blurred area that no opaque window above covers in the current frame
+    QRegion visibleArea;
+
     /// The render data per screen. Screens can have different color spaces.
     std::unordered_map<Output *, BlurNGRenderData> render;
 };
@@ -46,6 +93,12 @@ struct BlurNGEffectData
 class BlurNGEffect : public KWin::Effect
 {
     Q_OBJECT
+    Q_PROPERTY(qint64 renderMemoryUsage READ renderMemoryUsage)
+    Q_PROPERTY(qint64 maskMemoryUsage READ maskMemoryUsage)
+    Q_PROPERTY(qint64 peakMemoryUsage READ peakMemoryUsage)
+    Q_PROPERTY(quint32 maskCount READ maskCount)
+    Q_PROPERTY(qint64 maskPixels READ maskPixels)
+    Q_PROPERTY(quint64 maskLimitViolations READ maskLimitViolations)
 
 public:
     BlurNGEffect();
@@ -56,6 +109,7 @@ public:
 
     void reconfigure(ReconfigureFlags flags) override;
     void prePaintScreen(ScreenPrePaintData &data, std::chrono::milliseconds presentTime) override;
+    void postPaintScreen() override;
     void prePaintWindow(EffectWindow *w, WindowPrePaintData &data, std::chrono::milliseconds presentTime) override;
     void drawWindow(const RenderTarget &renderTarget, const RenderViewport &viewport, EffectWindow *w, int mask, const QRegion &region, WindowPaintData &data) override;
 
@@ -71,6 +125,27 @@ public:
 
     bool blocksDirectScanout() const override;
 
+    /**
+     * Supports the "memory" parameter, which reports the estimated video memory
+     * held by the effect per output, per client and per window.
+     */
+    QString debug(const QString &parameter) const override;
+
+    // for dbus/supportInformation, values are in bytes
+    qint64 renderMemoryUsage() const;
+    qint64 maskMemoryUsage() const;
+    qint64 peakMemoryUsage() const;
+
+    // Mask budgets summed over all clients, see BlurNGClientLimits
+    quint32 maskCount() const;
+    qint64 maskPixels() const;
+    quint64 maskLimitViolations() const;
+    /**
+     * The mask budget use per client, a map with executable, pid, masks, pixels
+     * and textureMemory each
+     */
+    Q_INVOKABLE QVariantList maskBudgets() const;
+
 public Q_SLOTS:
     void slotWindowAdded(KWin::EffectWindow *w);
     void slotWindowDeleted(KWin::EffectWindow *w);
@@ -78,18 +153,27 @@ public Q_SLOTS:
     void setupDecorationConnections(EffectWindow *w);
 
 private:
+    bool ensurePrograms();
     void initBlurNGStrengthValues();
-    QRegion blurRegion(EffectWindow *w) const;
     bool decorationSupportsBlurNGBehind(const EffectWindow *w) const;
     bool shouldBlur(const EffectWindow *w, int mask, const WindowPaintData &data) const;
     void updateBlurRegion(EffectWindow *w);
+    QRegion resolveBlurMasks(Output *screen);
+    void startStagedUploads();
+    void pollProgramLinking();
+    bool canPresentBlur(const EffectWindow *w) const;
+    void sendAppliedFeedback();
+    void sendPresentedFeedback(RenderLoop *loop, std::chrono::nanoseconds timestamp);
+    void evictIdleRenderData();
+    qint64 windowMaskMemoryUsage(EffectWindow *w) const;
+    void updatePeakMemoryUsage();
     void blur(const RenderTarget &renderTarget, const RenderViewport &viewport, EffectWindow *w, int mask, const QRegion &region, WindowPaintData &data);
     GLTexture *ensureNoiseTexture();
 
 private:
     struct
     {
-        std::unique_ptr<GLShader> shader;
+        std::unique_ptr<BlurNGProgram> shader;
         int mvpMatrixLocation;
         int offsetLocation;
         int halfpixelLocation;
@@ -97,15 +181,31 @@ private:
 
     struct
     {
-        std::unique_ptr<GLShader> shader;
+        std::unique_ptr<BlurNGProgram> shader;
         int mvpMatrixLocation;
         int offsetLocation;
         int halfpixelLocation;
+        int finalRoundLocation;
+        int alphaMaskLocation;
+        int originalLocation;
+        int backgroundScaleLocation;
+        int backgroundOffsetLocation;
     } m_upsamplePass;
 
+    // The final upsample pass of rect regions, it samples neither a mask nor the original background
     struct
     {
-        std::unique_ptr<GLShader> shader;
+        std::unique_ptr<BlurNGProgram> shader;
+        int mvpMatrixLocation;
+        int offsetLocation;
+        int halfpixelLocation;
+        int backgroundScaleLocation;
+        int backgroundOffsetLocation;
+    } m_upsampleRectPass;
+
+    struct
+    {
+        std::unique_ptr<BlurNGProgram> shader;
         int mvpMatrixLocation;
         int noiseTextureSizeLocation;
         int texStartPosLocation;
@@ -115,22 +215,40 @@ private:
         int noiseTextureStength = 0;
     } m_noisePass;
 
+    enum class ProgramState {
+        None,
+        Linking,
+        Ready,
+        Failed,
+    };
+    ProgramState m_programState = ProgramState::None;
+    QTimer m_linkPollTimer;
+
     bool m_valid = false;
-    QRegion m_paintedArea; // keeps track of all painted areas (from bottom to top)
-    QRegion m_currentBlur; // keeps track of the currently blured area of the windows(from bottom to top)
+    BlurNGPaintTracker m_paintTracker; // painted, damaged and blurred areas (from bottom to top)
+    bool m_visibleAreasPending = false; // the visible areas of this frame are not written yet
+    BlurNGRectList m_deferredArea; // blurred areas waiting for m_reblurTimer
+    QRegion m_pendingUploadArea; // blurred areas waiting for their masks to be uploaded
     Output *m_currentScreen = nullptr;
 
     size_t m_iterationCount; // number of times the texture will be downsized to half size
     int m_offset;
-    int m_expandSize;
+    qreal m_workingScale = 1.0; // resolution of the first texture relative to the background
+    bool m_reducedPrecisionChain = true;
+    int m_expandSize; // how far the blur samples outside of the blurred area
     int m_noiseStrength;
-    uint m_blurUpdateInterval = 1;
+    std::chrono::milliseconds m_maxStaleness;
+    QTimer m_reblurTimer;
+    QTimer m_uploadTimer;
+    std::chrono::milliseconds m_renderDataIdleTimeout;
+    bool m_hibernateBackdrop = true;
+    QTimer m_evictionTimer;
+    qint64 m_peakMemoryUsage = 0;
 
     struct OffsetStruct
     {
         float minOffset;
         float maxOffset;
-        int expandSize;
     };
 
     QList<OffsetStruct> blurOffsets;
@@ -144,6 +262,14 @@ private:
     QList<BlurNGValuesStruct> blurStrengthValues;
 
     std::unordered_map<EffectWindow *, BlurNGEffectData> m_windows;
+    // The regions prePaintWindow() built for every window, handed out again while they don't change
+    std::unordered_map<EffectWindow *, BlurNGPaintTracker::WindowCache> m_paintCaches;
+    BlurNGMaskUploader m_maskUploader;
+
+    // Scratch storage of blur(), kept to reuse its allocation across windows and frames
+    QList<QRectF> m_effectiveShape;
+    std::vector<QRect> m_scaledMaskShape;
+    std::vector<QRect> m_scaledRectShape;
 
     static BlurNGManagerInterface *s_blurManager;
     static QTimer *s_blurManagerRemoveTimer;
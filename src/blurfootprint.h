@@ -0,0 +1,38 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QRect>
+
+#include <cmath>
+#include <cstddef>
+
+namespace KWin
+{
+
+/**
+ * How far the chain reaches outside of the blurred area, in logical pixels.
+ *
+ * Level i has texels of 2^i pixels, a downsample pass samples offset / 2 + 1 texels of
+ * the level it reads and an upsample pass offset + 1 texels, the +1 being the bilinear
+ * footprint. Summed up over all levels that is (2^n - 1) * (2.5 * offset + 3) pixels of
+ * the working resolution.
+ */
+inline int blurExpandSize(size_t iterationCount, float offset, double workingScale)
+{
+    return std::ceil(((1 << iterationCount) - 1) * (2.5 * offset + 3) / workingScale);
+}
+
+/**
+ * The part of @p blurArea whose blurred result changes when @p damage is painted again.
+ */
+inline QRect blurredDamage(const QRect &damage, const QRect &blurArea, int expandSize)
+{
+    return damage.adjusted(-expandSize, -expandSize, expandSize, expandSize) & blurArea;
+}
+
+} // namespace KWin
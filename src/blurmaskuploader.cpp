@@ -0,0 +1,143 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "blurmaskuploader.h"
+
+#include "opengl/openglcontext.h"
+#include "utils/version.h"
+
+#include "kwinblurng_debug.h"
+
+namespace KWin
+{
+
+// Staging buffers kept around for the next uploads, the rest is freed
+static const size_t s_maxFreeBuffers = 4;
+
+BlurNGPendingTexture::BlurNGPendingTexture(std::shared_ptr<GLTexture> &&texture, GLuint buffer, GLsync fence, const std::weak_ptr<std::vector<GLuint>> &freeBuffers)
+    : m_texture(std::move(texture))
+    , m_buffer(buffer)
+    , m_fence(fence)
+    , m_freeBuffers(freeBuffers)
+{
+}
+
+BlurNGPendingTexture::~BlurNGPendingTexture()
+{
+    releaseBuffer();
+}
+
+bool BlurNGPendingTexture::isReady()
+{
+    if (m_fence) {
+        const GLenum status = glClientWaitSync(m_fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            return false;
+        }
+        releaseBuffer();
+    }
+    return true;
+}
+
+void BlurNGPendingTexture::releaseBuffer()
+{
+    if (m_fence) {
+        glDeleteSync(m_fence);
+        m_fence = nullptr;
+    }
+    if (m_buffer) {
+        auto freeBuffers = m_freeBuffers.lock();
+        if (freeBuffers && freeBuffers->size() < s_maxFreeBuffers) {
+            freeBuffers->push_back(m_buffer);
+        } else {
+            glDeleteBuffers(1, &m_buffer);
+        }
+        m_buffer = 0;
+    }
+}
+
+BlurNGMaskUploader::BlurNGMaskUploader()
+    : m_freeBuffers(std::make_shared<std::vector<GLuint>>())
+{
+}
+
+BlurNGMaskUploader::~BlurNGMaskUploader()
+{
+    if (!m_freeBuffers->empty()) {
+        glDeleteBuffers(m_freeBuffers->size(), m_freeBuffers->data());
+    }
+}
+
+GLuint BlurNGMaskUploader::acquireBuffer()
+{
+    if (!m_freeBuffers->empty()) {
+        const GLuint buffer = m_freeBuffers->back();
+        m_freeBuffers->pop_back();
+        return buffer;
+    }
+    GLuint buffer = 0;
+    glGenBuffers(1, &buffer);
+    return buffer;
+}
+
+std::unique_ptr<BlurNGPendingTexture> BlurNGMaskUploader::upload(const QSize &size, const std::function<bool(QImage &)> &fill)
+{
+    if (!m_supported) {
+        // Pixel buffer objects, mapped buffer ranges and fences
+        const auto context = OpenGlContext::currentContext();
+        m_supported = context->isOpenGLES() ? context->hasVersion(Version(3, 0)) : context->hasVersion(Version(3, 2));
+    }
+
+    if (!*m_supported || size.isEmpty()) {
+        return nullptr;
+    }
+
+    const qsizetype bytes = qsizetype(size.width()) * size.height();
+    const GLuint buffer = acquireBuffer();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    // Orphans the previous storage, the driver doesn't have to wait for an older upload
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+    auto data = static_cast<uchar *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (!data) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        m_supported = false;
+        return nullptr;
+    }
+
+    // Tightly packed rows, the pixels are written once and never copied on the CPU
+    QImage target(data, size.width(), size.height(), size.width(), QImage::Format_Grayscale8);
+    const bool filled = fill(target);
+    // The storage can get lost, e.g. on a mode switch, the caller falls back then
+    const bool intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+    if (!filled || !intact) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        m_freeBuffers->push_back(buffer);
+        return nullptr;
+    }
+
+    auto texture = GLTexture::allocate(GL_R8, size);
+    if (!texture) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        m_freeBuffers->push_back(buffer);
+        return nullptr;
+    }
+    // Same orientation as GLTexture::upload()
+    texture->setContentTransform(OutputTransform::FlipY);
+
+    texture->bind();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(texture->target(), 0, 0, 0, size.width(), size.height(), GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    texture->unbind();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    const GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return std::unique_ptr<BlurNGPendingTexture>(new BlurNGPendingTexture(std::move(texture), buffer, fence, m_freeBuffers));
+}
+
+} // namespace KWin
@@ -0,0 +1,82 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <opengl/glutils.h>
+
+#include <QImage>
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace KWin
+{
+
+/**
+ * A mask texture whose pixels are still being copied by the GPU.
+ */
+class BlurNGPendingTexture
+{
+public:
+    ~BlurNGPendingTexture();
+
+    /**
+     * Polls the fence of the upload without blocking. Once it returns true the
+     * texture can be sampled and the staging buffer goes back to the uploader.
+     */
+    bool isReady();
+
+    std::shared_ptr<GLTexture> texture() const
+    {
+        return m_texture;
+    }
+
+private:
+    friend class BlurNGMaskUploader;
+    BlurNGPendingTexture(std::shared_ptr<GLTexture> &&texture, GLuint buffer, GLsync fence, const std::weak_ptr<std::vector<GLuint>> &freeBuffers);
+    void releaseBuffer();
+
+    std::shared_ptr<GLTexture> m_texture;
+    GLuint m_buffer;
+    GLsync m_fence;
+    std::weak_ptr<std::vector<GLuint>> m_freeBuffers;
+};
+
+/**
+ * Uploads masks through a ring of pixel buffer objects.
+ *
+ * GLTexture::upload() copies the pixels synchronously while the frame is being
+ * prepared. Here the pixels are written straight into the mapped storage of a
+ * pixel buffer object and copied into the texture by the GPU, the texture is
+ * used once the copy has finished.
+ */
+class BlurNGMaskUploader
+{
+public:
+    BlurNGMaskUploader();
+    ~BlurNGMaskUploader();
+
+    /**
+     * Starts uploading a single channel mask of @p size. @p fill writes the pixels
+     * into the image it is given, which wraps the mapped buffer, and returns false
+     * if it can't.
+     *
+     * Returns nullptr if the mask can't be uploaded asynchronously or @p fill failed,
+     * the caller has to fall back to GLTexture::upload() in the first case.
+     */
+    std::unique_ptr<BlurNGPendingTexture> upload(const QSize &size, const std::function<bool(QImage &)> &fill);
+
+private:
+    GLuint acquireBuffer();
+
+    std::optional<bool> m_supported;
+    std::shared_ptr<std::vector<GLuint>> m_freeBuffers;
+};
+
+} // namespace KWin
@@ -0,0 +1,51 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <opengl/gltexture.h>
+
+namespace KWin
+{
+
+/**
+ * Estimates the video memory used by @p texture from its internal format and size.
+ *
+ * Drivers may pad or compress the storage, the value is meant for accounting and
+ * not as an exact figure.
+ */
+inline qint64 textureMemoryUsage(const GLTexture *texture)
+{
+    if (!texture) {
+        return 0;
+    }
+
+    qint64 bytesPerPixel;
+    switch (texture->internalFormat()) {
+    case GL_R8:
+        bytesPerPixel = 1;
+        break;
+    case GL_RG8:
+    case GL_R16F:
+        bytesPerPixel = 2;
+        break;
+    case GL_RGBA16F:
+    case GL_RGBA16:
+        bytesPerPixel = 8;
+        break;
+    case GL_RGBA32F:
+        bytesPerPixel = 16;
+        break;
+    default:
+        // GL_RGBA8, GL_RGB10_A2, GL_R11F_G11F_B10F, ...
+        bytesPerPixel = 4;
+        break;
+    }
+
+    return qint64(texture->width()) * texture->height() * bytesPerPixel;
+}
+
+} // namespace KWin
@@ -0,0 +1,146 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "blurpainttracker.h"
+#include "blurfootprint.h"
+
+#include <algorithm>
+
+namespace KWin
+{
+
+// QRegion::contains() tells whether the rect overlaps, not whether it's inside
+static bool containsRect(const QRegion &region, const QRect &rect)
+{
+    return std::any_of(region.begin(), region.end(), [&rect](const QRect &regionRect) {
+        return regionRect.contains(rect);
+    });
+}
+
+void BlurNGPaintTracker::setExpandSize(int expandSize)
+{
+    m_expandSize = expandSize;
+}
+
+void BlurNGPaintTracker::clear()
+{
+    m_paintedArea.clear();
+    m_currentBlur.clear();
+    m_damagedArea.clear();
+}
+
+void BlurNGPaintTracker::shrinkOpaque(QRegion &opaque, WindowCache &cache)
+{
+    // to blur an area partially we have to shrink the opaque area of a window,
+    // only the rects covering a blurred area matter
+    m_opaqueScratch.clear();
+    for (const QRect &rect : opaque) {
+        if (m_currentBlur.intersects(rect)) {
+            m_opaqueScratch.push_back(rect.adjusted(m_expandSize, m_expandSize, -m_expandSize, -m_expandSize));
+        } else {
+            m_opaqueScratch.push_back(rect);
+        }
+    }
+
+    if (m_opaqueScratch != cache.opaqueRects) {
+        QRegion shrunk;
+        for (const QRect &rect : m_opaqueScratch) {
+            shrunk += rect;
+        }
+        cache.opaqueRects = m_opaqueScratch;
+        cache.opaque = shrunk;
+    }
+    opaque = cache.opaque;
+}
+
+void BlurNGPaintTracker::addRepaint(QRegion &paint, const QRect &repaint, WindowCache &cache)
+{
+    if (containsRect(paint, repaint)) {
+        return;
+    }
+    if (repaint != cache.repaint || paint != cache.paint) {
+        cache.paint = paint;
+        cache.repaint = repaint;
+        cache.repainted = paint + repaint;
+    }
+    paint = cache.repainted;
+}
+
+bool BlurNGPaintTracker::addWindow(QRegion &paint, QRegion &opaque, WindowCache &cache, const BlurredWindow *blurred)
+{
+    const QRegion damage = paint;
+    const QRegion oldOpaque = opaque;
+    if (m_currentBlur.intersects(opaque)) {
+        shrinkOpaque(opaque, cache);
+
+        // we don't have to blur a region we don't see
+        m_currentBlur.subtract(opaque);
+    }
+
+    // if we have to paint a non-opaque part of this window that intersects with the
+    // currently blurred region we have to redraw the whole region
+    if (m_currentBlur.intersectsUncovered(paint, oldOpaque)) {
+        m_currentBlur.unite(paint);
+    }
+
+    bool backgroundDamaged = false;
+    if (blurred && !blurred->area.isEmpty()) {
+        const QRect &blurArea = blurred->area;
+        // The blur samples from the surroundings of the blurred area as well
+        const QRect footprint = blurArea.adjusted(-m_expandSize, -m_expandSize, m_expandSize, m_expandSize);
+
+        // if this window or a window underneath the footprint is painted again we have to
+        // blur the part of the blurred area that the painted rects reach
+        if (m_paintedArea.intersects(footprint) || paint.intersects(footprint)) {
+            // Without a background cached for this spot the whole footprint has to be painted
+            // to fill it, the parts that are not painted again would be left uninitialized
+            QRect repaint;
+            if (blurred->cached) {
+                for (const QRect &rect : m_paintedArea) {
+                    if (rect.intersects(footprint)) {
+                        repaint |= blurredDamage(rect, blurArea, m_expandSize);
+                    }
+                }
+                for (const QRect &rect : paint) {
+                    if (rect.intersects(footprint)) {
+                        repaint |= blurredDamage(rect, blurArea, m_expandSize);
+                    }
+                }
+            } else {
+                repaint = footprint;
+            }
+            addRepaint(paint, repaint, cache);
+
+            // we have to check again whether we do not damage a blurred area
+            // of a window
+            if (m_currentBlur.intersects(repaint)) {
+                m_currentBlur.unite(paint);
+            }
+        }
+
+        // The chain only has to be blurred again if the content behind the window changed,
+        // repaints that merely propagate through blurred areas don't count.
+        backgroundDamaged = m_damagedArea.intersects(footprint);
+
+        // Opaque windows painted later hide parts of it again
+        m_currentBlur.insert(blurArea, blurred->visibleArea);
+    }
+
+    m_paintedArea.subtract(opaque);
+    m_paintedArea.add(paint);
+
+    m_damagedArea.subtract(opaque);
+    m_damagedArea.add(damage);
+
+    return backgroundDamaged;
+}
+
+void BlurNGPaintTracker::updateVisibleAreas()
+{
+    m_currentBlur.updateVisibleAreas();
+}
+
+} // namespace KWin
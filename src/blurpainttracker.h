@@ -0,0 +1,91 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "blurrectlist.h"
+#include "blurspatialindex.h"
+
+#include <QRect>
+#include <QRegion>
+
+#include <vector>
+
+namespace KWin
+{
+
+/**
+ * The bookkeeping prePaintWindow() does from the bottom to the top of the stack: which
+ * areas are painted, whether the background behind a blurred window changed and how
+ * much of every blurred area stays visible.
+ *
+ * The paint and opaque regions of a window are only changed where the blur needs it.
+ * The regions built for a window are kept in its WindowCache and handed out again as
+ * long as the window paints the same, so a steady frame doesn't allocate.
+ */
+class BlurNGPaintTracker
+{
+public:
+    /**
+     * The regions of a window kept from one frame to the next
+     */
+    struct WindowCache
+    {
+        std::vector<QRect> opaqueRects;
+        QRegion opaque;
+        QRegion paint;
+        QRect repaint;
+        QRegion repainted;
+    };
+
+    /**
+     * The blurred part of a window
+     */
+    struct BlurredWindow
+    {
+        /// The bounding rect of the blurred area, in global coordinates
+        QRect area;
+        /// A background is cached for area, otherwise the whole footprint is painted
+        bool cached;
+        /// Receives the part of area no opaque window above covers, see updateVisibleAreas()
+        QRegion *visibleArea;
+    };
+
+    /**
+     * How far the blur samples outside of the blurred area
+     */
+    void setExpandSize(int expandSize);
+
+    /**
+     * Starts a frame, the storage is kept
+     */
+    void clear();
+
+    /**
+     * Adds the next window up the stack and updates its @p paint and @p opaque regions.
+     * @p blurred is null for windows without a blurred area.
+     *
+     * @returns whether something was painted behind the blurred area of the window
+     */
+    bool addWindow(QRegion &paint, QRegion &opaque, WindowCache &cache, const BlurredWindow *blurred);
+
+    /**
+     * Writes the visible areas once all windows are added
+     */
+    void updateVisibleAreas();
+
+private:
+    void shrinkOpaque(QRegion &opaque, WindowCache &cache);
+    void addRepaint(QRegion &paint, const QRect &repaint, WindowCache &cache);
+
+    int m_expandSize = 0;
+    BlurNGRectList m_paintedArea; // keeps track of all painted areas (from bottom to top)
+    BlurNGSpatialIndex m_currentBlur; // keeps track of the currently blured area of the windows(from bottom to top)
+    BlurNGRectList m_damagedArea; // keeps track of the damaged areas of the windows (from bottom to top)
+    std::vector<QRect> m_opaqueScratch;
+};
+
+} // namespace KWin
@@ -0,0 +1,289 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "blurprogram.h"
+
+#include "opengl/glplatform.h"
+#include "opengl/openglcontext.h"
+#include "utils/version.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "kwinblurng_debug.h"
+
+namespace KWin
+{
+
+static const quint32 s_programCacheMagic = 0x4b424e47; // "KBNG"
+static const quint32 s_programCacheVersion = 1;
+
+// Mirrors ShaderManager::resolveShaderFilePath(), core profiles use the *_core variants
+static QString resolveShaderFilePath(const QString &filePath)
+{
+    const auto context = OpenGlContext::currentContext();
+    const Version coreVersionNumber = context->isOpenGLES() ? Version(3, 0) : Version(1, 40);
+    if (context->glPlatform()->glslVersion() < coreVersionNumber) {
+        return filePath;
+    }
+    const int dot = filePath.lastIndexOf(QLatin1Char('.'));
+    return filePath.left(dot) + QStringLiteral("_core") + filePath.mid(dot);
+}
+
+// Mirrors GLShader::prepareSource()
+static QByteArray prepareSource(const QByteArray &source)
+{
+    const auto context = OpenGlContext::currentContext();
+    const bool gles = context->isOpenGLES();
+    const Version glslVersion = context->glPlatform()->glslVersion();
+
+    QByteArray ba;
+    if (gles && glslVersion < Version(3, 0)) {
+        ba.append("precision highp float;\n");
+    }
+    ba.append(source);
+    if (gles && glslVersion >= Version(3, 0)) {
+        ba.replace("#version 140", "#version 300 es\n\nprecision highp float;\n");
+    }
+    return ba;
+}
+
+static QByteArray readShaderFile(const QString &filePath)
+{
+    QFile file(resolveShaderFilePath(filePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(KWIN_BLUR) << "Failed to read shader" << file.fileName();
+        return QByteArray();
+    }
+    return prepareSource(file.readAll());
+}
+
+// #version has to stay the first line
+static QByteArray insertDefines(QByteArray source, const QByteArray &defines)
+{
+    const qsizetype position = source.startsWith("#version") ? source.indexOf('\n') + 1 : 0;
+    return source.insert(position, defines);
+}
+
+static bool supportsProgramBinary()
+{
+    if (qEnvironmentVariableIntValue("KWIN_BLURNG_NO_PROGRAM_CACHE")) {
+        return false;
+    }
+
+    const auto context = OpenGlContext::currentContext();
+    if (context->isOpenGLES()) {
+        if (!context->hasVersion(Version(3, 0))) {
+            return false;
+        }
+    } else if (!context->hasVersion(Version(4, 1)) && !context->hasOpenglExtension(QByteArrayLiteral("GL_ARB_get_program_binary"))) {
+        return false;
+    }
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+static QString programCacheFilePath(const QByteArray &vertexSource, const QByteArray &fragmentSource)
+{
+    // Program binaries are only valid for the driver build that produced them
+    const GLPlatform *gl = OpenGlContext::currentContext()->glPlatform();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(gl->glVendorString());
+    hash.addData(gl->glRendererString());
+    hash.addData(gl->glVersionString());
+    hash.addData(vertexSource);
+    hash.addData(fragmentSource);
+
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+        + QStringLiteral("/kwin/blurng/")
+        + QString::fromLatin1(hash.result().toHex())
+        + QStringLiteral(".bin");
+}
+
+static bool loadProgramBinary(const QString &fileName, GLuint program)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 format = 0;
+    QByteArray binary;
+
+    QDataStream stream(&file);
+    stream >> magic >> version >> format >> binary;
+    if (stream.status() != QDataStream::Ok || magic != s_programCacheMagic || version != s_programCacheVersion || binary.isEmpty()) {
+        qCDebug(KWIN_BLUR) << "Discarding malformed program binary" << fileName;
+        file.remove();
+        return false;
+    }
+
+    glProgramBinary(program, format, binary.constData(), binary.size());
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        // The driver rejects binaries it can't use anymore, e.g. after an update.
+        // The program is linked from source instead, a failed load leaves it empty.
+        qCDebug(KWIN_BLUR) << "Discarding stale program binary" << fileName;
+        file.remove();
+        return false;
+    }
+
+    return true;
+}
+
+static void storeProgramBinary(const QString &fileName, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    QByteArray binary(length, Qt::Uninitialized);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+    if (!QDir().mkpath(QFileInfo(fileName).absolutePath())) {
+        qCWarning(KWIN_BLUR) << "Failed to create the program cache directory for" << fileName;
+        return;
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(KWIN_BLUR) << "Failed to open" << fileName << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << s_programCacheMagic << s_programCacheVersion << quint32(format) << binary;
+    if (!file.commit()) {
+        qCWarning(KWIN_BLUR) << "Failed to write" << fileName << file.errorString();
+    }
+}
+
+static bool supportsParallelShaderCompile()
+{
+    const auto context = OpenGlContext::currentContext();
+    return context->hasOpenglExtension(QByteArrayLiteral("GL_KHR_parallel_shader_compile"));
+}
+
+static void compileShader(GLuint program, GLenum shaderType, const QByteArray &source)
+{
+    const GLuint shader = glCreateShader(shaderType);
+    const char *src = source.constData();
+    glShaderSource(shader, 1, &src, nullptr);
+    glCompileShader(shader);
+
+    // The shader is only flagged for deletion, it stays alive as long as it's attached.
+    // Compile errors end up in the program info log, querying the status here would block.
+    glAttachShader(program, shader);
+    glDeleteShader(shader);
+}
+
+static void linkProgram(GLuint program, const QByteArray &vertexSource, const QByteArray &fragmentSource, bool retrievable)
+{
+    compileShader(program, GL_VERTEX_SHADER, vertexSource);
+    compileShader(program, GL_FRAGMENT_SHADER, fragmentSource);
+
+    glBindAttribLocation(program, VA_Position, "position");
+    glBindAttribLocation(program, VA_TexCoord, "texcoord");
+    if (!OpenGlContext::currentContext()->isOpenGLES()) {
+        glBindFragDataLocation(program, 0, "fragColor");
+    }
+    if (retrievable) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    glLinkProgram(program);
+}
+
+BlurNGProgram::BlurNGProgram(const QString &cacheFile)
+    : GLShader(ExplicitLinking)
+    , m_handle(programId())
+    , m_cacheFile(cacheFile)
+{
+}
+
+std::unique_ptr<BlurNGProgram> BlurNGProgram::create(const QString &vertexFile, const QString &fragmentFile, const QByteArray &fragmentDefines)
+{
+    const QByteArray vertexSource = readShaderFile(vertexFile);
+    QByteArray fragmentSource = readShaderFile(fragmentFile);
+    // The defines alone would pass for a source
+    if (vertexSource.isEmpty() || fragmentSource.isEmpty()) {
+        return nullptr;
+    }
+    fragmentSource = insertDefines(fragmentSource, fragmentDefines);
+
+    const bool binaryCache = supportsProgramBinary();
+    const QString cacheFile = binaryCache ? programCacheFilePath(vertexSource, fragmentSource) : QString();
+    std::unique_ptr<BlurNGProgram> ret(new BlurNGProgram(cacheFile));
+    if (binaryCache && loadProgramBinary(cacheFile, ret->m_handle)) {
+        ret->m_status = Status::Linked;
+        ret->m_cacheFile.clear();
+        return ret;
+    }
+
+    static const bool parallel = [] {
+        if (!supportsParallelShaderCompile()) {
+            return false;
+        }
+        // Let the driver pick the number of compiler threads
+        glMaxShaderCompilerThreadsKHR(0xffffffff);
+        return true;
+    }();
+
+    linkProgram(ret->m_handle, vertexSource, fragmentSource, binaryCache);
+    if (!parallel) {
+        ret->finishLinking();
+    }
+    return ret;
+}
+
+BlurNGProgram::Status BlurNGProgram::status()
+{
+    if (m_status == Status::Linking) {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(m_handle, GL_COMPLETION_STATUS_KHR, &completed);
+        if (completed == GL_TRUE) {
+            finishLinking();
+        }
+    }
+    return m_status;
+}
+
+void BlurNGProgram::finishLinking()
+{
+    GLint status = GL_FALSE;
+    glGetProgramiv(m_handle, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        GLint length = 0;
+        glGetProgramiv(m_handle, GL_INFO_LOG_LENGTH, &length);
+        QByteArray log(length, 0);
+        glGetProgramInfoLog(m_handle, length, nullptr, log.data());
+        qCWarning(KWIN_BLUR) << "Failed to link program:" << log;
+        m_status = Status::Failed;
+        return;
+    }
+
+    m_status = Status::Linked;
+    if (!m_cacheFile.isEmpty()) {
+        storeProgramBinary(m_cacheFile, m_handle);
+    }
+}
+
+} // namespace KWin
@@ -0,0 +1,67 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <opengl/glutils.h>
+
+#include <QByteArray>
+#include <QString>
+
+#include <memory>
+
+namespace KWin
+{
+
+/**
+ * A linked GL program for one of the blur passes.
+ *
+ * The GL program object is the one GLShader creates, so the program can be bound
+ * through the ShaderManager stack like any other shader. Unlike GLShader, the
+ * effect links it itself, so that it can be stored to and restored from the
+ * on-disk program binary cache.
+ */
+class BlurNGProgram : public GLShader
+{
+public:
+    enum class Status {
+        Linking,
+        Linked,
+        Failed,
+    };
+
+    /**
+     * Loads the program from the binary cache or, if there is no usable entry,
+     * compiles it from the given resource files and refreshes the cache.
+     *
+     * With GL_KHR_parallel_shader_compile the driver links in the background and
+     * the returned program stays in the Linking state until status() says otherwise.
+     *
+     * @p fragmentDefines are put in front of the fragment shader, so that variants
+     * of a pass can share their source.
+     */
+    static std::unique_ptr<BlurNGProgram> create(const QString &vertexFile, const QString &fragmentFile, const QByteArray &fragmentDefines = QByteArray());
+
+    /**
+     * Polls the driver without blocking if the program is still being linked.
+     */
+    Status status();
+
+    GLuint program() const
+    {
+        return m_handle;
+    }
+
+private:
+    explicit BlurNGProgram(const QString &cacheFile);
+    void finishLinking();
+
+    GLuint m_handle = 0;
+    Status m_status = Status::Linking;
+    QString m_cacheFile;
+};
+
+} // namespace KWin
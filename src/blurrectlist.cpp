@@ -0,0 +1,117 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "blurrectlist.h"
+
+#include <algorithm>
+
+namespace KWin
+{
+
+void BlurNGRectList::clear()
+{
+    m_rects.clear();
+    m_bounds = QRect();
+}
+
+bool BlurNGRectList::merge(QRect &target, const QRect &rect)
+{
+    // Only rects that share a full edge and touch or overlap form a rect together
+    const bool sameRow = rect.top() == target.top() && rect.bottom() == target.bottom()
+        && rect.left() <= target.right() + 1 && rect.right() >= target.left() - 1;
+    const bool sameColumn = rect.left() == target.left() && rect.right() == target.right()
+        && rect.top() <= target.bottom() + 1 && rect.bottom() >= target.top() - 1;
+    if (!sameRow && !sameColumn) {
+        return false;
+    }
+    target |= rect;
+    return true;
+}
+
+void BlurNGRectList::add(const QRegion &region)
+{
+    for (const QRect &rect : region) {
+        add(rect);
+    }
+}
+
+void BlurNGRectList::add(const QRect &rect)
+{
+    if (rect.isEmpty()) {
+        return;
+    }
+
+    QRect added = rect;
+    for (size_t i = 0; i < m_rects.size();) {
+        const QRect existing = m_rects[i];
+        if (existing.contains(added)) {
+            // Rects dropped so far lie within added, and so within existing
+            return;
+        }
+        const bool contained = added.contains(existing);
+        if (contained || merge(added, existing)) {
+            m_rects[i] = m_rects.back();
+            m_rects.pop_back();
+            // A grown rect may now swallow or join rects that were checked already
+            i = contained ? i : 0;
+            continue;
+        }
+        ++i;
+    }
+    m_rects.push_back(added);
+    m_bounds |= added;
+}
+
+void BlurNGRectList::subtract(const QRegion &region)
+{
+    for (const QRect &cut : region) {
+        subtract(cut);
+    }
+}
+
+void BlurNGRectList::subtract(const QRect &cut)
+{
+    if (!m_bounds.intersects(cut) || !intersects(cut)) {
+        return;
+    }
+
+    // Every rect that overlaps is split into the bands above and below the cut
+    // and the parts left and right of it
+    m_scratch.clear();
+    for (const QRect &rect : m_rects) {
+        if (!rect.intersects(cut)) {
+            m_scratch.push_back(rect);
+            continue;
+        }
+        if (rect.top() < cut.top()) {
+            m_scratch.push_back(QRect(QPoint(rect.left(), rect.top()), QPoint(rect.right(), cut.top() - 1)));
+        }
+        if (rect.bottom() > cut.bottom()) {
+            m_scratch.push_back(QRect(QPoint(rect.left(), cut.bottom() + 1), QPoint(rect.right(), rect.bottom())));
+        }
+        const int top = std::max(rect.top(), cut.top());
+        const int bottom = std::min(rect.bottom(), cut.bottom());
+        if (rect.left() < cut.left()) {
+            m_scratch.push_back(QRect(QPoint(rect.left(), top), QPoint(cut.left() - 1, bottom)));
+        }
+        if (rect.right() > cut.right()) {
+            m_scratch.push_back(QRect(QPoint(cut.right() + 1, top), QPoint(rect.right(), bottom)));
+        }
+    }
+    std::swap(m_rects, m_scratch);
+}
+
+bool BlurNGRectList::intersects(const QRect &rect) const
+{
+    if (!m_bounds.intersects(rect)) {
+        return false;
+    }
+    return std::any_of(m_rects.cbegin(), m_rects.cend(), [&rect](const QRect &candidate) {
+        return candidate.intersects(rect);
+    });
+}
+
+} // namespace KWin
@@ -0,0 +1,67 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QRect>
+#include <QRegion>
+
+#include <vector>
+
+namespace KWin
+{
+
+/**
+ * An area made of possibly overlapping rects, for the areas prePaintWindow() tracks
+ * from the bottom to the top of the stack.
+ *
+ * Unlike QRegion, which allocates new data on every union or subtraction, the rects
+ * live in vectors that keep their capacity across frames. Only intersection tests
+ * are answered. Rects that are already covered are skipped and rects that together
+ * form a rect are merged, so the list doesn't grow with every window.
+ */
+class BlurNGRectList
+{
+public:
+    /**
+     * Removes all rects and keeps the storage
+     */
+    void clear();
+
+    void add(const QRegion &region);
+    void add(const QRect &rect);
+    void subtract(const QRegion &region);
+    void subtract(const QRect &rect);
+
+    bool intersects(const QRect &rect) const;
+
+    bool isEmpty() const
+    {
+        return m_rects.empty();
+    }
+
+    auto begin() const
+    {
+        return m_rects.cbegin();
+    }
+    auto end() const
+    {
+        return m_rects.cend();
+    }
+    int size() const
+    {
+        return m_rects.size();
+    }
+
+private:
+    static bool merge(QRect &target, const QRect &rect);
+
+    std::vector<QRect> m_rects;
+    QRect m_bounds;
+    std::vector<QRect> m_scratch;
+};
+
+} // namespace KWin
@@ -0,0 +1,55 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "blurshape.h"
+
+#include "core/pixelgrid.h"
+#include "effect/globals.h"
+
+namespace KWin
+{
+
+// infiniteRegion() builds a new region on every call
+static bool isInfiniteRegion(const QRegion &region)
+{
+    static const QRect infiniteRect = infiniteRegion().boundingRect();
+    return region.rectCount() == 1 && region.boundingRect() == infiniteRect;
+}
+
+static void appendClippedShape(QList<QRectF> &effectiveShape, const BlurNGShapeClip &clip, const QRect &clipRect, std::span<const QRect> shape)
+{
+    const QRectF deviceClipRect = snapToPixelGridF(scaledRect(clipRect, clip.scale))
+                                      .translated(-clip.deviceBackgroundRect.topLeft());
+    for (const QRect &shapeRect : shape) {
+        const QRectF deviceShapeRect = snapToPixelGridF(scaledRect(shapeRect.translated(clip.shapeToBackground), clip.scale));
+        if (const QRectF intersected = deviceClipRect.intersected(deviceShapeRect); !intersected.isEmpty()) {
+            effectiveShape.append(intersected);
+        }
+    }
+}
+
+void appendBlurShape(QList<QRectF> &effectiveShape, const BlurNGShapeClip &clip, std::span<const QRect> shape)
+{
+    if (!clip.clipToVisible && isInfiniteRegion(clip.paintRegion)) {
+        for (const QRect &rect : shape) {
+            effectiveShape.append(snapToPixelGridF(scaledRect(rect.translated(clip.shapeToBackground), clip.scale)));
+        }
+        return;
+    }
+    for (const QRect &paintRect : clip.paintRegion) {
+        if (!clip.clipToVisible) {
+            appendClippedShape(effectiveShape, clip, paintRect, shape);
+            continue;
+        }
+        for (const QRect &visibleRect : clip.visibleArea) {
+            if (const QRect clipRect = paintRect & visibleRect; !clipRect.isEmpty()) {
+                appendClippedShape(effectiveShape, clip, clipRect, shape);
+            }
+        }
+    }
+}
+
+} // namespace KWin
@@ -0,0 +1,42 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QList>
+#include <QRect>
+#include <QRegion>
+
+#include <span>
+
+namespace KWin
+{
+
+/**
+ * What blur() clips the blur shape of a window to
+ */
+struct BlurNGShapeClip
+{
+    /// The region painted in this frame, in logical coordinates
+    QRegion paintRegion;
+    /// The part of the blurred area that no opaque window above covers
+    QRegion visibleArea;
+    /// Whether to clip to visibleArea as well, only needed if a window covers some of it
+    bool clipToVisible = false;
+    /// Moves the shape rects to the background rect
+    QPoint shapeToBackground;
+    QRect deviceBackgroundRect;
+    qreal scale = 1.0;
+};
+
+/**
+ * Appends what @p clip leaves of @p shape to @p effectiveShape, in device pixels relative to
+ * the background texture. Runs for every blurred window in every frame, it only allocates
+ * if @p effectiveShape has to grow.
+ */
+void appendBlurShape(QList<QRectF> &effectiveShape, const BlurNGShapeClip &clip, std::span<const QRect> shape);
+
+} // namespace KWin
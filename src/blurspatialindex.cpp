@@ -0,0 +1,193 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "blurspatialindex.h"
+
+#include <algorithm>
+
+namespace KWin
+{
+
+// 256x256 px cells
+static const int s_cellShift = 8;
+
+qint64 BlurNGSpatialIndex::cellKey(int x, int y)
+{
+    return (qint64(x) << 32) | quint32(y);
+}
+
+void BlurNGSpatialIndex::clear()
+{
+    for (auto &[key, cell] : m_cells) {
+        cell.clear();
+    }
+    m_entryCount = 0;
+    m_bounds = QRect();
+    m_stamp = 0;
+}
+
+void BlurNGSpatialIndex::insert(const QRect &bounds, QRegion *visibleArea)
+{
+    const quint32 index = m_entryCount++;
+    if (index == m_entries.size()) {
+        m_entries.emplace_back();
+    }
+    Entry &entry = m_entries[index];
+    entry.bounds = bounds;
+    entry.visibleArea = visibleArea;
+    entry.visible.clear();
+    entry.visible.add(bounds);
+    entry.stamp = 0;
+    m_bounds |= bounds;
+
+    for (int y = bounds.top() >> s_cellShift; y <= bounds.bottom() >> s_cellShift; ++y) {
+        for (int x = bounds.left() >> s_cellShift; x <= bounds.right() >> s_cellShift; ++x) {
+            m_cells[cellKey(x, y)].push_back(index);
+        }
+    }
+}
+
+template<typename Func>
+bool BlurNGSpatialIndex::visit(const QRect &queryRect, Func func)
+{
+    // Paint regions can be infinite, only walk the cells that can hold entries
+    const QRect rect = queryRect & m_bounds;
+    if (rect.isEmpty()) {
+        return false;
+    }
+
+    // An entry spanning several cells is only handed out once per query
+    ++m_stamp;
+
+    for (int y = rect.top() >> s_cellShift; y <= rect.bottom() >> s_cellShift; ++y) {
+        for (int x = rect.left() >> s_cellShift; x <= rect.right() >> s_cellShift; ++x) {
+            const auto it = m_cells.find(cellKey(x, y));
+            if (it == m_cells.end()) {
+                continue;
+            }
+            for (const quint32 index : it->second) {
+                Entry &entry = m_entries[index];
+                if (entry.stamp == m_stamp) {
+                    continue;
+                }
+                entry.stamp = m_stamp;
+                if (entry.bounds.intersects(rect) && func(entry)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool BlurNGSpatialIndex::intersects(const QRect &rect)
+{
+    return visit(rect, [&rect](const Entry &entry) {
+        return entry.visible.intersects(rect);
+    });
+}
+
+bool BlurNGSpatialIndex::intersects(const QRegion &region)
+{
+    for (const QRect &rect : region) {
+        if (intersects(rect)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BlurNGSpatialIndex::intersectsUncovered(const QRegion &region, const QRegion &cover)
+{
+    for (const QRect &rect : region) {
+        const bool found = visit(rect, [&rect, &cover](const Entry &entry) {
+            for (const QRect &visibleRect : entry.visible) {
+                const QRect overlap = visibleRect & rect;
+                if (overlap.isEmpty()) {
+                    continue;
+                }
+                if (std::none_of(cover.begin(), cover.end(), [&overlap](const QRect &coverRect) {
+                        return coverRect.contains(overlap);
+                    })) {
+                    return true;
+                }
+            }
+            return false;
+        });
+        if (found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BlurNGSpatialIndex::subtract(const QRegion &region)
+{
+    for (const QRect &rect : region) {
+        visit(rect, [&rect](Entry &entry) {
+            entry.visible.subtract(rect);
+            return false;
+        });
+    }
+}
+
+void BlurNGSpatialIndex::unite(QRegion &region) const
+{
+    for (size_t i = 0; i < m_entryCount; ++i) {
+        for (const QRect &rect : m_entries[i].visible) {
+            // Every union allocates, skip the rects the region has already
+            if (std::none_of(region.begin(), region.end(), [&rect](const QRect &regionRect) {
+                    return regionRect.contains(rect);
+                })) {
+                region += rect;
+            }
+        }
+    }
+}
+
+static qint64 area(const QRect &rect)
+{
+    return qint64(rect.width()) * rect.height();
+}
+
+bool BlurNGSpatialIndex::holds(const QRegion &region, const BlurNGRectList &rects)
+{
+    // The rects are disjoint, as are the ones of the region. Same area and every rect
+    // covered by the region means both are the same area.
+    qint64 regionArea = 0;
+    for (const QRect &regionRect : region) {
+        regionArea += area(regionRect);
+    }
+    qint64 rectsArea = 0;
+    for (const QRect &rect : rects) {
+        qint64 covered = 0;
+        for (const QRect &regionRect : region) {
+            covered += area(regionRect & rect);
+        }
+        if (covered != area(rect)) {
+            return false;
+        }
+        rectsArea += area(rect);
+    }
+    return rectsArea == regionArea;
+}
+
+void BlurNGSpatialIndex::updateVisibleAreas()
+{
+    for (size_t i = 0; i < m_entryCount; ++i) {
+        const Entry &entry = m_entries[i];
+        if (holds(*entry.visibleArea, entry.visible)) {
+            continue;
+        }
+        QRegion visibleArea;
+        for (const QRect &rect : entry.visible) {
+            visibleArea += rect;
+        }
+        *entry.visibleArea = visibleArea;
+    }
+}
+
+} // namespace KWin
@@ -0,0 +1,93 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "blurrectlist.h"
+
+#include <QRect>
+#include <QRegion>
+
+#include <unordered_map>
+#include <vector>
+
+namespace KWin
+{
+
+/**
+ * A uniform grid over the blurred areas of the current frame.
+ *
+ * prePaintWindow() tests the paint and opaque regions of every window against the
+ * areas blurred below it. The grid limits those tests to the blurred windows that
+ * share a cell with the tested rect instead of walking one ever growing QRegion.
+ *
+ * The visible part of every blurred area is tracked as a rect list while the frame is
+ * set up and written to the region handed to insert(), BlurNGEffectData::visibleArea,
+ * by updateVisibleAreas(). Cells and entries keep their allocations across frames.
+ */
+class BlurNGSpatialIndex
+{
+public:
+    void clear();
+
+    /**
+     * Adds a blurred area, its visible part is written to @p visibleArea by
+     * updateVisibleAreas()
+     */
+    void insert(const QRect &bounds, QRegion *visibleArea);
+
+    /**
+     * Writes the visible part of every blurred area to its region. Regions that
+     * already hold that area are left alone, so a steady frame doesn't allocate.
+     */
+    void updateVisibleAreas();
+
+    /**
+     * Whether @p rect or @p region overlaps the visible part of any blurred area
+     */
+    bool intersects(const QRect &rect);
+    bool intersects(const QRegion &region);
+
+    /**
+     * Whether a part of @p region that no rect of @p cover contains overlaps the visible
+     * part of any blurred area. Parts covered by several rects together count as uncovered.
+     */
+    bool intersectsUncovered(const QRegion &region, const QRegion &cover);
+
+    /**
+     * Removes @p region from the visible part of the blurred areas it overlaps
+     */
+    void subtract(const QRegion &region);
+
+    /**
+     * Adds the visible parts of all blurred areas to @p region
+     */
+    void unite(QRegion &region) const;
+
+private:
+    struct Entry
+    {
+        QRect bounds;
+        QRegion *visibleArea;
+        BlurNGRectList visible;
+        quint32 stamp;
+    };
+
+    template<typename Func>
+    bool visit(const QRect &rect, Func func);
+
+    static qint64 cellKey(int x, int y);
+    static bool holds(const QRegion &region, const BlurNGRectList &rects);
+
+    // Entries past m_entryCount are kept for the storage of their rect lists
+    std::vector<Entry> m_entries;
+    size_t m_entryCount = 0;
+    QRect m_bounds;
+    std::unordered_map<qint64, std::vector<quint32>> m_cells;
+    quint32 m_stamp = 0;
+};
+
+} // namespace KWin
@@ -10,26 +10,39 @@
 #include <QGuiApplication>
 #include <QPainter>
 #include "blurclient.h"
+#include "blurmaskaggregator.h"
+
+#include <algorithm>
 
 BlurBehind::BlurBehind(QQuickItem *parent)
     : QQuickItem(parent)
 {
     connect(this, &BlurBehind::intensityChanged, this, &BlurBehind::refresh);
+    connect(this, &BlurBehind::maskScaleChanged, this, &BlurBehind::refresh);
 }
 
 BlurBehind::~BlurBehind()
 {
+    releaseMask();
+}
+
+void BlurBehind::releaseMask()
+{
+    if (m_aggregator) {
+        m_aggregator->removeItem(this);
+    }
+    m_aggregator.clear();
 }
 
 void BlurBehind::refresh()
 {
     if (!m_completed || !window() || !window()->isVisible() || !BlurManager::instance()->isInitialized()) {
-        m_mask.reset();
+        releaseMask();
         return;
     }
 
     if (!isVisible() || !m_activated || width() <= 0 || height() <= 0 || m_intensity < 0.01) {
-        m_mask.reset();
+        releaseMask();
         return;
     }
 
@@ -38,7 +51,7 @@ void BlurBehind::refresh()
         anyVisibleChild |= x->isVisible() && x->opacity() > 0.01;
     }
     if (!anyVisibleChild) {
-        m_mask.reset();
+        releaseMask();
         return;
     }
 
@@ -47,25 +60,26 @@ void BlurBehind::refresh()
         return;
     }
 
-    m_lastGrab = grabToImage();
+    // Reduced masks are grabbed at their size right away, not scaled down afterwards
+    const qreal scale = std::clamp<qreal>(m_maskScale, 1.0 / 120, 1);
+    m_lastGrab = scale < 1 ? grabToImage((size() * scale).toSize().expandedTo(QSize(1, 1))) : grabToImage();
     if (!m_lastGrab) {
         return;
     }
 
-    connect(m_lastGrab.data(), &QQuickItemGrabResult::ready, this, [this]() {
+    connect(m_lastGrab.data(), &QQuickItemGrabResult::ready, this, [this, scale]() {
         if (!window()) {
-            m_mask.reset();
+            releaseMask();
             return;
         }
         auto image = m_lastGrab->image().convertedTo(QImage::Format_Alpha8);
-        if (!m_mask) {
-            m_mask = std::make_unique<BlurMask>(BlurManager::instance()->get_blur_mask());
+        // The item may have moved to another window since the last grab
+        auto aggregator = BlurMaskAggregator::get(window());
+        if (m_aggregator != aggregator) {
+            releaseMask();
+            m_aggregator = aggregator;
         }
-        m_mask->setIntensity(m_intensity);
-        m_mask->setGeometry({mapToGlobal({0, 0}), QSizeF{width(), height()}});
-        m_mask->setMask(std::move(image));
-        m_mask->sendDone();
-        m_mask->setSurface(BlurManager::instance()->surface(window()));
+        m_aggregator->setItem(this, {mapToGlobal({0, 0}), QSizeF{width(), height()}}, image, m_intensity, scale);
         if (m_schedule) {
             QTimer::singleShot(0, this, &BlurBehind::refresh);
             m_schedule = false;
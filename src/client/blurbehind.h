@@ -7,12 +7,12 @@
 #ifndef BLURBEHIND_H
 #define BLURBEHIND_H
 
+#include <QPointer>
 #include <QQmlParserStatus>
 #include <QQuickItem>
 #include <QtQmlIntegration>
 
-class BlurManager;
-class BlurMask;
+class BlurMaskAggregator;
 
 class BlurBehind : public QQuickItem
 {
@@ -21,6 +21,11 @@ class BlurBehind : public QQuickItem
     QML_ADDED_IN_VERSION(1, 0)
     Q_PROPERTY(bool activated READ activated WRITE setActivated NOTIFY activatedChanged)
     Q_PROPERTY(qreal intensity MEMBER m_intensity NOTIFY intensityChanged)
+    /**
+     * The resolution the children are grabbed and sent at relative to the item
+     * size, e.g. 0.25 grabs a sixteenth of the pixels.
+     */
+    Q_PROPERTY(qreal maskScale MEMBER m_maskScale NOTIFY maskScaleChanged)
 public:
     BlurBehind(QQuickItem *target = nullptr);
     ~BlurBehind() override;
@@ -38,6 +43,7 @@ public:
 Q_SIGNALS:
     void activatedChanged();
     void intensityChanged(qreal intensity);
+    void maskScaleChanged();
 
 protected:
     void itemChange(ItemChange change, const ItemChangeData &value) override;
@@ -45,12 +51,14 @@ protected:
 
 private:
     void refresh();
+    void releaseMask();
     bool m_completed = true;
     bool m_activated = true;
-    std::unique_ptr<BlurMask> m_mask;
+    QPointer<BlurMaskAggregator> m_aggregator;
     QSharedPointer<QQuickItemGrabResult> m_lastGrab;
     bool m_schedule = false;
     qreal m_intensity = 1.;
+    qreal m_maskScale = 1.;
 };
 
 #endif
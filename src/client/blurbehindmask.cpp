@@ -9,15 +9,29 @@
 #include <QPainter>
 #include <QQuickWindow>
 #include "blurclient.h"
+#include "blurmaskaggregator.h"
+
+#include <algorithm>
 
 BlurBehindMask::BlurBehindMask(QQuickItem *parent)
     : QQuickItem(parent)
 {
     connect(this, &BlurBehindMask::intensityChanged, this, &BlurBehindMask::refresh);
+    connect(this, &BlurBehindMask::maskScaleChanged, this, &BlurBehindMask::refresh);
+    connect(this, &BlurBehindMask::blurWholeItemChanged, this, &BlurBehindMask::refresh);
 }
 
 BlurBehindMask::~BlurBehindMask()
 {
+    releaseMask();
+}
+
+void BlurBehindMask::releaseMask()
+{
+    if (m_aggregator) {
+        m_aggregator->removeItem(this);
+    }
+    m_aggregator.clear();
 }
 
 void BlurBehindMask::geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry)
@@ -26,9 +40,8 @@ void BlurBehindMask::geometryChange(const QRectF &newGeometry, const QRectF &old
     Q_UNUSED(oldGeometry);
     QQuickItem::geometryChange(newGeometry, oldGeometry);
 
-    if (m_mask) {
-        m_mask->setGeometry({mapToGlobal({0, 0}), QSizeF{width(), height()}});
-        m_mask->sendDone();
+    if (m_aggregator) {
+        refresh();
     }
 }
 
@@ -44,25 +57,24 @@ void BlurBehindMask::componentComplete()
 
 void BlurBehindMask::refresh()
 {
-    if (!m_completed || !window() || !window()->isVisible() || m_maskPath.isNull() || !BlurManager::instance()->isInitialized()) {
-        m_mask.reset();
+    // Without a mask the item is only blurred fully if asked to, a mask that failed to load blurs nothing
+    const bool noMask = m_maskImage.isNull() && (!m_blurWholeItem || !m_maskPath.isNull());
+    if (!m_completed || !window() || !window()->isVisible() || noMask || !BlurManager::instance()->isInitialized()) {
+        releaseMask();
         return;
     }
 
     if (!isVisible() || !m_activated || width() <= 0 || height() <= 0 || m_intensity <= 0) {
-        m_mask.reset();
+        releaseMask();
         return;
     }
 
-    const bool create = !m_mask;
-    if (create) {
-        m_mask = std::make_unique<BlurMask>(BlurManager::instance()->get_blur_mask());
-        m_mask->setMask(m_maskImage);
+    auto aggregator = BlurMaskAggregator::get(window());
+    if (m_aggregator != aggregator) {
+        releaseMask();
+        m_aggregator = aggregator;
     }
-    m_mask->setIntensity(m_intensity);
-    m_mask->setGeometry({mapToGlobal({0, 0}), QSizeF{width(), height()}});
-    m_mask->sendDone();
-    m_mask->setSurface(BlurManager::instance()->surface(window()));
+    m_aggregator->setItem(this, {mapToGlobal({0, 0}), QSizeF{width(), height()}}, m_maskImage, m_intensity, std::clamp<qreal>(m_maskScale, 1.0 / 120, 1));
 }
 
 void BlurBehindMask::setMaskPath(const QString &maskPath)
@@ -78,13 +90,6 @@ void BlurBehindMask::setMaskPath(const QString &maskPath)
 void BlurBehindMask::setMask(const QImage& mask)
 {
     m_maskImage = mask.convertedTo(QImage::Format_Grayscale8);
-    if (!m_mask) {
-        refresh();
-    } else {
-        m_mask->setGeometry({mapToGlobal({0, 0}), QSizeF{width(), height()}});
-        m_mask->setIntensity(m_intensity);
-        m_mask->setMask(m_maskImage);
-        m_mask->sendDone();
-    }
+    refresh();
     Q_EMIT maskChanged();
 }
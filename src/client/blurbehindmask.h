@@ -7,12 +7,12 @@
 #pragma once
 
 #include <QImage>
+#include <QPointer>
 #include <QQmlParserStatus>
 #include <QQuickItem>
 #include <QtQmlIntegration>
 
-class BlurManager;
-class BlurMask;
+class BlurMaskAggregator;
 
 class BlurBehindMask : public QQuickItem
 {
@@ -20,9 +20,23 @@ class BlurBehindMask : public QQuickItem
     QML_NAMED_ELEMENT(BlurBehindMask)
     QML_ADDED_IN_VERSION(1, 0)
     Q_PROPERTY(bool activated READ activated WRITE setActivated NOTIFY activatedChanged)
+    /**
+     * The mask is stretched over the item. Without one nothing is blurred, unless
+     * blurWholeItem is set.
+     */
     Q_PROPERTY(QString maskPath READ maskPath WRITE setMaskPath NOTIFY maskPathChanged)
     Q_PROPERTY(QImage mask READ mask WRITE setMask NOTIFY maskChanged)
     Q_PROPERTY(qreal intensity MEMBER m_intensity NOTIFY intensityChanged)
+    /**
+     * The resolution the mask is sent at relative to the item size, e.g. 0.25 sends
+     * a sixteenth of the pixels. Smooth masks lose nothing visible behind the blur.
+     */
+    Q_PROPERTY(qreal maskScale MEMBER m_maskScale NOTIFY maskScaleChanged)
+    /**
+     * Blurs the whole item when neither maskPath nor mask is set, which costs the
+     * compositor no mask at all
+     */
+    Q_PROPERTY(bool blurWholeItem MEMBER m_blurWholeItem NOTIFY blurWholeItemChanged)
 public:
     BlurBehindMask(QQuickItem *target = nullptr);
     ~BlurBehindMask() override;
@@ -49,16 +63,21 @@ Q_SIGNALS:
     void maskPathChanged();
     void maskChanged();
     void intensityChanged();
+    void maskScaleChanged();
+    void blurWholeItemChanged();
 
 protected:
     void geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry) override;
 
 private:
     void refresh();
+    void releaseMask();
     bool m_completed = true;
     bool m_activated = true;
     QString m_maskPath;
     QImage m_maskImage;
     qreal m_intensity = 1;
-    std::unique_ptr<BlurMask> m_mask;
+    qreal m_maskScale = 1;
+    bool m_blurWholeItem = false;
+    QPointer<BlurMaskAggregator> m_aggregator;
 };
@@ -7,6 +7,9 @@
 #include "blurclient.h"
 #include <QGuiApplication>
 
+#include <algorithm>
+#include <cmath>
+
 inline wl_surface *surfaceForWindow(QWindow *window)
 {
     if (!window) {
@@ -21,28 +24,201 @@ inline wl_surface *surfaceForWindow(QWindow *window)
     return reinterpret_cast<wl_surface *>(native->nativeResourceForWindow(QByteArrayLiteral("surface"), window));
 }
 
+static size_t maskHash(const QImage &mask)
+{
+    // Rows may be padded, only the pixels count
+    const qsizetype rowBytes = qsizetype(mask.width()) * mask.depth() / 8;
+    size_t hash = qHashMulti(0, mask.width(), mask.height(), int(mask.format()));
+    for (int y = 0; y < mask.height(); ++y) {
+        hash = qHashBits(mask.constScanLine(y), rowBytes, hash);
+    }
+    return hash;
+}
+
+void BlurMask::setMask(const QImage &mask)
+{
+    // Held until sendDone() only, the caller may write to its image afterwards without a detach
+    m_mask = mask;
+    // The hash covers the size and format too
+    const size_t hash = maskHash(mask);
+    if (hash == m_maskHash) {
+        return;
+    }
+    m_maskHash = hash;
+    m_dirty = true;
+}
+
+/**
+ * Packs @p mask to one bit per pixel, the mask must only hold 0 and 255
+ */
+static QImage encodeBitmap(const QImage &mask)
+{
+    QImage encoded((mask.width() + 7) / 8, mask.height(), QImage::Format_Grayscale8);
+    encoded.fill(0);
+    for (int y = 0; y < mask.height(); ++y) {
+        const uchar *in = mask.constScanLine(y);
+        uchar *out = encoded.scanLine(y);
+        for (int x = 0; x < mask.width(); ++x) {
+            if (in[x]) {
+                out[x / 8] |= 0x80 >> (x % 8);
+            }
+        }
+    }
+    return encoded;
+}
+
+/**
+ * Run-length encodes every row of @p mask in (count, value) pairs, the rows of
+ * the result are as wide as the longest encoded row
+ */
+static QImage encodeRle(const QImage &mask, int rowLength)
+{
+    QImage encoded(rowLength, mask.height(), QImage::Format_Grayscale8);
+    encoded.fill(0);
+    for (int y = 0; y < mask.height(); ++y) {
+        const uchar *in = mask.constScanLine(y);
+        uchar *out = encoded.scanLine(y);
+        for (int x = 0; x < mask.width();) {
+            int count = 1;
+            while (x + count < mask.width() && count < 255 && in[x + count] == in[x]) {
+                ++count;
+            }
+            *out++ = count;
+            *out++ = in[x];
+            x += count;
+        }
+    }
+    return encoded;
+}
+
+/**
+ * Picks the most compact encoding for @p mask and encodes it
+ */
+static QImage encodeMask(const QImage &mask, mbition_blur_mask_v1_encoding *encoding)
+{
+    bool binary = true;
+    int rleRowLength = 0;
+    for (int y = 0; y < mask.height(); ++y) {
+        const uchar *line = mask.constScanLine(y);
+        int rowLength = 0;
+        for (int x = 0; x < mask.width();) {
+            binary &= line[x] == 0 || line[x] == 255;
+            int count = 1;
+            while (x + count < mask.width() && count < 255 && line[x + count] == line[x]) {
+                ++count;
+            }
+            rowLength += 2;
+            x += count;
+        }
+        rleRowLength = std::max(rleRowLength, rowLength);
+    }
+
+    // Masks with anti-aliased edges compress better as runs, unless the edges are most of the mask
+    const int bitmapRowLength = (mask.width() + 7) / 8;
+    if (binary && bitmapRowLength <= rleRowLength) {
+        *encoding = MBITION_BLUR_MASK_V1_ENCODING_BITMAP;
+        return encodeBitmap(mask);
+    }
+    if (rleRowLength < mask.width() / 2) {
+        *encoding = MBITION_BLUR_MASK_V1_ENCODING_RLE;
+        return encodeRle(mask, rleRowLength);
+    }
+    *encoding = MBITION_BLUR_MASK_V1_ENCODING_R8;
+    return mask;
+}
+
 void BlurMask::sendMask()
 {
-    if (m_intensity != 1 && !m_mask.isNull()) {
-        QImage withIntensity = m_mask.copy();
-        for (int y = 0; y < withIntensity.height(); ++y) {
-            auto line = withIntensity.scanLine(y);
-            for (int x = 0; x < withIntensity.width(); ++x) {
+    QImage mask = m_mask;
+    // Older compositors expect masks at the size of the surface
+    const bool scalable = mbition_blur_mask_v1_get_version(object()) >= MBITION_BLUR_MASK_V1_SET_SCALE_SINCE_VERSION;
+    if (scalable && m_scale != 1 && !mask.isNull()) {
+        // The compositor stretches the mask over the geometry with linear filtering
+        const QSize size = (m_geo.size() * m_scale).toSize().expandedTo(QSize(1, 1));
+        if (size.width() < mask.width() || size.height() < mask.height()) {
+            mask = mask.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation).convertToFormat(m_mask.format());
+        }
+    }
+    if (m_intensity != 1 && !mask.isNull()) {
+        // scanLine() detaches from m_mask
+        for (int y = 0; y < mask.height(); ++y) {
+            auto line = mask.scanLine(y);
+            for (int x = 0; x < mask.width(); ++x) {
                 line[x] *= m_intensity;
             }
         }
-        m_maskBuffer = Shm::instance()->createBuffer(withIntensity);
+    }
+
+    // Older compositors only take R8 buffers
+    const bool encodable = mbition_blur_mask_v1_get_version(object()) >= MBITION_BLUR_MASK_V1_SET_MASK_ENCODING_SINCE_VERSION;
+    if (!mask.isNull() && (mask.format() == QImage::Format_Grayscale8 || mask.format() == QImage::Format_Alpha8) && encodable) {
+        mbition_blur_mask_v1_encoding encoding;
+        const QImage encoded = encodeMask(mask, &encoding);
+        if (encoding != m_encoding || mask.size() != m_encodedSize) {
+            set_mask_encoding(encoding, mask.width(), mask.height());
+            m_encoding = encoding;
+            m_encodedSize = mask.size();
+        }
+        m_maskBuffer = Shm::instance()->createBuffer(encoded);
     } else {
-        m_maskBuffer = Shm::instance()->createBuffer(m_mask);
+        // The compositor would decode the plain buffer with the previous encoding
+        if (!mask.isNull() && encodable && m_encoding != MBITION_BLUR_MASK_V1_ENCODING_R8) {
+            set_mask_encoding(MBITION_BLUR_MASK_V1_ENCODING_R8, mask.width(), mask.height());
+            m_encoding = MBITION_BLUR_MASK_V1_ENCODING_R8;
+            m_encodedSize = mask.size();
+        }
+        m_maskBuffer = Shm::instance()->createBuffer(mask);
     }
 
     if (m_maskBuffer) {
+        if (scalable && m_sentScale != m_scale) {
+            set_scale(std::lround(m_scale * 120));
+            m_sentScale = m_scale;
+        }
         set_mask(m_maskBuffer->object());
+        m_dirty = false;
     } else {
         qCWarning(KWINBLURNG_CLIENT) << "Failed to create mask";
     }
 }
 
+void BlurSurface::requestApplied()
+{
+    if (m_appliedCallback || mbition_blur_surface_v1_get_version(object()) < MBITION_BLUR_SURFACE_V1_APPLIED_SINCE_VERSION) {
+        return;
+    }
+    static const wl_callback_listener listener = {
+        .done = handleApplied,
+    };
+    m_appliedCallback = applied();
+    wl_callback_add_listener(m_appliedCallback, &listener, this);
+}
+
+void BlurSurface::handleApplied(void *data, wl_callback *callback, uint32_t time)
+{
+    Q_UNUSED(time);
+    auto surface = static_cast<BlurSurface *>(data);
+    wl_callback_destroy(callback);
+    surface->m_appliedCallback = nullptr;
+    Q_EMIT surface->blurApplied();
+}
+
+void BlurSurface::setRegion(const QRegion &region)
+{
+    if (m_region == region || !supportsRegion()) {
+        return;
+    }
+    m_region = region;
+
+    QByteArray rects;
+    rects.reserve(region.rectCount() * 4 * sizeof(int32_t));
+    for (const QRect &rect : region) {
+        const int32_t values[] = {rect.x(), rect.y(), rect.width(), rect.height()};
+        rects.append(reinterpret_cast<const char *>(values), sizeof(values));
+    }
+    set_region(rects);
+}
+
 BlurSurface* BlurManager::surface(QWindow* window)
 {
     Q_ASSERT(isInitialized());
@@ -34,16 +34,46 @@ public:
 
     ~BlurSurface() override
     {
+        if (m_appliedCallback) {
+            wl_callback_destroy(m_appliedCallback);
+        }
         destroy();
     }
 
+    /**
+     * Asks the compositor to emit blurApplied() once the blur of the next commit
+     * is presented. Does nothing if a request is still pending or the compositor
+     * doesn't support it.
+     */
+    void requestApplied();
+    /**
+     * Whether blur state that was sent earlier hasn't been presented yet
+     */
+    bool isPresenting() const
+    {
+        return m_appliedCallback;
+    }
+
+    /**
+     * Blurs @p region fully, without a mask. Only sent if it changed.
+     */
+    void setRegion(const QRegion &region);
+    bool supportsRegion() const
+    {
+        return mbition_blur_surface_v1_get_version(object()) >= MBITION_BLUR_SURFACE_V1_SET_REGION_SINCE_VERSION;
+    }
+
 Q_SIGNALS:
     void forgetSurface(QWindow *window);
+    void blurApplied();
 
 private:
+    static void handleApplied(void *data, wl_callback *callback, uint32_t time);
 
     friend class BlurManager;
     QWindow *const m_window;
+    wl_callback *m_appliedCallback = nullptr;
+    QRegion m_region;
 };
 
 class BlurMask : public QtWayland::mbition_blur_mask_v1
@@ -60,21 +90,33 @@ public:
         destroy();
     }
 
-    void setMask(const QImage &mask) {
-        if (m_mask == mask) {
+    /**
+     * Sets the pixels of the mask, they are only sent if they changed. The mask lets
+     * go of them in sendDone(), they have to be set before every sendDone() that may
+     * send the mask.
+     */
+    void setMask(const QImage &mask);
+    void setIntensity(qreal intensity) {
+        if (m_intensity == intensity) {
             return;
         }
-
-        m_mask = mask;
+        m_intensity = intensity;
         m_dirty = true;
     }
-    void setIntensity(qreal intensity) {
-        m_intensity = intensity;
+    void setScale(qreal scale) {
+        if (m_scale == scale) {
+            return;
+        }
+        m_scale = scale;
         m_dirty = true;
     }
     void setGeometry(const QRectF& geo) {
         if (geo == m_geo)
             return;
+        // Reduced masks are rendered for the size of the geometry
+        if (m_scale != 1 && geo.size() != m_geo.size()) {
+            m_dirty = true;
+        }
         m_geo = geo;
         set_geometry(geo.x(), geo.y(), geo.width(), geo.height());
     }
@@ -93,18 +135,34 @@ public:
         }
     }
 
+    /**
+     * Sends the mask, it stays dirty if no buffer could be created for it
+     */
     void sendMask();
+    /**
+     * Applies the pending state, the mask is only sent again if it changed
+     */
     void sendDone() {
         if (m_dirty) {
             sendMask();
         }
+        m_mask = QImage();
         done();
     }
 
     qreal m_intensity = 1;
+    qreal m_scale = 1;
+    /// The scale last announced to the compositor
+    qreal m_sentScale = 1;
     QRectF m_geo;
+    /// The pixels set since the last sendDone()
     QImage m_mask;
+    /// Hash of the pixels last set, regrabbing the same pixels doesn't resend them
+    size_t m_maskHash = 0;
     bool m_dirty = true;
+    /// The encoding last announced to the compositor and the size it decodes to
+    mbition_blur_mask_v1_encoding m_encoding = MBITION_BLUR_MASK_V1_ENCODING_R8;
+    QSize m_encodedSize;
     std::unique_ptr<ShmBuffer> m_maskBuffer;
     QPointer<BlurSurface> m_surface;
 };
@@ -113,7 +171,7 @@ class BlurManager : public QWaylandClientExtensionTemplate<BlurManager>, public
 {
 public:
     BlurManager()
-        : QWaylandClientExtensionTemplate<BlurManager>(1)
+        : QWaylandClientExtensionTemplate<BlurManager>(5)
     {
         initialize();
     }
@@ -124,6 +182,13 @@ public:
     }
 
     BlurSurface *surface(QWindow *window);
+    /**
+     * The blur surface of @p window if it has one already
+     */
+    BlurSurface *findSurface(QWindow *window) const
+    {
+        return m_surfaces.value(window);
+    }
 
 private:
     QHash<QWindow *, BlurSurface *> m_surfaces;
@@ -0,0 +1,288 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "blurmaskaggregator.h"
+#include "blurclient.h"
+
+#include <QWindow>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+BlurMaskAggregator::BlurMaskAggregator(QWindow *window)
+    : QObject(window)
+    , m_window(window)
+{
+    m_updateTimer.setSingleShot(true);
+    m_updateTimer.setInterval(0);
+    connect(&m_updateTimer, &QTimer::timeout, this, &BlurMaskAggregator::update);
+}
+
+BlurMaskAggregator::~BlurMaskAggregator() = default;
+
+BlurMaskAggregator *BlurMaskAggregator::get(QWindow *window)
+{
+    if (auto aggregator = window->findChild<BlurMaskAggregator *>(QString(), Qt::FindDirectChildrenOnly)) {
+        return aggregator;
+    }
+    return new BlurMaskAggregator(window);
+}
+
+void BlurMaskAggregator::setItem(const QObject *item, const QRectF &geometry, const QImage &mask, qreal intensity, qreal scale)
+{
+    auto it = m_items.find(item);
+    if (it != m_items.end()) {
+        if (it->geometry == geometry && it->mask.cacheKey() == mask.cacheKey() && it->intensity == intensity && it->scale == scale) {
+            return;
+        }
+        scheduleUpdate(it->geometry.toAlignedRect());
+    } else {
+        it = m_items.insert(item, Item{});
+    }
+
+    it->geometry = geometry;
+    if (it->mask.cacheKey() != mask.cacheKey()) {
+        it->mask = mask.depth() == 8 ? mask : mask.convertToFormat(QImage::Format_Alpha8);
+        it->scaled = QImage();
+    }
+    it->intensity = intensity;
+    it->scale = scale;
+    scheduleUpdate(geometry.toAlignedRect());
+}
+
+void BlurMaskAggregator::removeItem(const QObject *item)
+{
+    const auto it = m_items.constFind(item);
+    if (it == m_items.constEnd()) {
+        return;
+    }
+    scheduleUpdate(it->geometry.toAlignedRect());
+    m_items.erase(it);
+}
+
+void BlurMaskAggregator::scheduleUpdate(const QRegion &damage)
+{
+    m_damage += damage;
+    m_updateTimer.start();
+}
+
+/**
+ * Groups @p rects into the areas that are sent as one mask each. Two areas are
+ * merged while the mask covering both has barely more pixels than two separate
+ * masks, or while there are more areas than masks are worth sending.
+ */
+static QList<QRect> clusterRects(QList<QRect> rects)
+{
+    // A mask costs requests, a buffer and a texture, about as much as this many pixels
+    constexpr qint64 maskCost = 64 * 64;
+    constexpr int maxMasks = 8;
+    const auto area = [](const QRect &rect) {
+        return qint64(rect.width()) * rect.height();
+    };
+
+    while (rects.size() > 1) {
+        qsizetype first = 0;
+        qsizetype second = 0;
+        qint64 leastWaste = std::numeric_limits<qint64>::max();
+        for (qsizetype i = 0; i < rects.size(); ++i) {
+            for (qsizetype j = i + 1; j < rects.size(); ++j) {
+                // Negative for overlapping rects, their pixels would be sent twice
+                const qint64 waste = area(rects[i] | rects[j]) - area(rects[i]) - area(rects[j]);
+                if (waste < leastWaste) {
+                    leastWaste = waste;
+                    first = i;
+                    second = j;
+                }
+            }
+        }
+        if (leastWaste > maskCost && rects.size() <= maxMasks) {
+            break;
+        }
+        rects[first] |= rects[second];
+        rects.removeAt(second);
+    }
+    return rects;
+}
+
+QRect BlurMaskAggregator::toComposite(const Cluster &cluster, const QRectF &rect)
+{
+    return QRectF((rect.topLeft() - cluster.bounds.topLeft()) * cluster.scale, rect.size() * cluster.scale).toAlignedRect();
+}
+
+bool BlurMaskAggregator::isRect(const Item &item) const
+{
+    return m_regions && item.mask.isNull() && item.intensity >= 1;
+}
+
+void BlurMaskAggregator::compose(Cluster &cluster, Item &item, const QRect &clip)
+{
+    const QRect rect = toComposite(cluster, item.geometry);
+    const QRect area = rect & clip;
+    if (area.isEmpty()) {
+        return;
+    }
+
+    if (item.mask.isNull()) {
+        // The compositor doesn't take regions or the item isn't blurred fully
+        const int value = qRound(item.intensity * 255);
+        for (int y = area.top(); y <= area.bottom(); ++y) {
+            uchar *out = cluster.composite.scanLine(y) + area.x();
+            for (int x = 0; x < area.width(); ++x) {
+                out[x] = std::min(255, out[x] + value);
+            }
+        }
+        return;
+    }
+
+    if (item.scaled.size() != rect.size()) {
+        item.scaled = item.mask.size() == rect.size()
+            ? item.mask
+            : item.mask.scaled(rect.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation).convertToFormat(item.mask.format());
+    }
+
+    // Saturating sum, the same as the compositor does for separate masks
+    const int intensity = qRound(item.intensity * 256);
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        const uchar *in = item.scaled.constScanLine(y - rect.y()) + (area.x() - rect.x());
+        uchar *out = cluster.composite.scanLine(y) + area.x();
+        for (int x = 0; x < area.width(); ++x) {
+            out[x] = std::min(255, out[x] + ((in[x] * intensity) >> 8));
+        }
+    }
+}
+
+void BlurMaskAggregator::update()
+{
+    if (m_items.isEmpty()) {
+        m_clusters.clear();
+        m_damage = QRegion();
+        if (auto surface = BlurManager::instance()->findSurface(m_window)) {
+            surface->setRegion(QRegion());
+        }
+        m_window->requestUpdate();
+        return;
+    }
+
+    BlurSurface *surface = BlurManager::instance()->surface(m_window);
+    if (surface && surface->isPresenting()) {
+        // Changes are held back until the compositor presented the previous ones
+        connect(surface, &BlurSurface::blurApplied, this, &BlurMaskAggregator::flush, Qt::UniqueConnection);
+        m_updateDeferred = true;
+        return;
+    }
+    m_updateDeferred = false;
+
+    // Fully blurred rectangles need no mask at all
+    const bool regions = surface && surface->supportsRegion();
+    if (regions != m_regions) {
+        m_regions = regions;
+        m_clusters.clear();
+    }
+
+    QRegion region;
+    QList<QRect> rects;
+    for (const Item &item : std::as_const(m_items)) {
+        if (isRect(item)) {
+            region += item.geometry.toAlignedRect();
+        } else {
+            rects.append(item.geometry.toAlignedRect());
+        }
+    }
+
+    if (surface) {
+        surface->setRegion(region);
+    }
+
+    // Clusters that kept their bounds keep their composite and mask, the masks of
+    // the others are destroyed with them
+    std::vector<Cluster> clusters;
+    for (const QRect &bounds : clusterRects(rects)) {
+        auto it = std::find_if(m_clusters.begin(), m_clusters.end(), [&bounds](const Cluster &cluster) {
+            return cluster.mask && cluster.bounds == bounds;
+        });
+        if (it != m_clusters.end()) {
+            clusters.push_back(std::move(*it));
+        } else {
+            clusters.push_back(Cluster{.bounds = bounds});
+        }
+    }
+    m_clusters = std::move(clusters);
+
+    // Composed at the finest scale of the items of a cluster
+    std::vector<qreal> scales(m_clusters.size(), 0);
+    for (Item &item : m_items) {
+        if (isRect(item)) {
+            item.cluster = -1;
+            continue;
+        }
+        const QRect rect = item.geometry.toAlignedRect();
+        int cluster = 0;
+        while (!m_clusters[cluster].bounds.contains(rect)) {
+            ++cluster;
+        }
+        if (item.cluster != cluster) {
+            // Gone from the composite of its previous cluster
+            m_damage += rect;
+            item.cluster = cluster;
+        }
+        scales[cluster] = std::max(scales[cluster], item.scale);
+    }
+
+    const QRegion damage = std::exchange(m_damage, QRegion());
+    for (size_t i = 0; i < m_clusters.size(); ++i) {
+        Cluster &cluster = m_clusters[i];
+        QRegion clusterDamage = damage & cluster.bounds;
+        if (scales[i] != cluster.scale || cluster.composite.isNull()) {
+            cluster.scale = scales[i];
+            cluster.composite = QImage((QSizeF(cluster.bounds.size()) * cluster.scale).toSize().expandedTo(QSize(1, 1)), QImage::Format_Grayscale8);
+            clusterDamage = cluster.bounds;
+        }
+        if (clusterDamage.isEmpty()) {
+            continue;
+        }
+
+        for (const QRect &rect : clusterDamage) {
+            const QRect clip = toComposite(cluster, rect) & cluster.composite.rect();
+            if (clip.isEmpty()) {
+                continue;
+            }
+            for (int y = clip.top(); y <= clip.bottom(); ++y) {
+                std::memset(cluster.composite.scanLine(y) + clip.x(), 0, clip.width());
+            }
+            for (Item &item : m_items) {
+                if (item.cluster == int(i)) {
+                    compose(cluster, item, clip);
+                }
+            }
+        }
+
+        if (!cluster.mask) {
+            cluster.mask = std::make_unique<BlurMask>(BlurManager::instance()->get_blur_mask());
+        }
+        cluster.mask->setScale(cluster.scale);
+        cluster.mask->setGeometry(cluster.bounds);
+        // The mask lets go of the pixels in sendDone(), the composite is written in place next time
+        cluster.mask->setMask(cluster.composite);
+        cluster.mask->sendDone();
+        cluster.mask->setSurface(surface);
+    }
+
+    if (surface) {
+        surface->requestApplied();
+    }
+    // The blur state only applies with the next commit of the window
+    m_window->requestUpdate();
+}
+
+void BlurMaskAggregator::flush()
+{
+    if (!std::exchange(m_updateDeferred, false)) {
+        return;
+    }
+    update();
+}
@@ -0,0 +1,95 @@
+/*
+    SPDX-FileCopyrightText: 2025 MBition GmbH
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#pragma once
+
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QRegion>
+#include <QTimer>
+
+#include <memory>
+#include <vector>
+
+class BlurMask;
+class QWindow;
+
+/**
+ * Combines the masks of all the blur items of a window into a few masks.
+ *
+ * Every item hands its mask and geometry over, the aggregator composes them on
+ * the next event loop iteration. Items that lie close together share one
+ * mbition_blur_mask_v1, items far apart get masks of their own, so the empty
+ * space between them isn't sent. Only the areas of the items that changed are
+ * composed again. While the compositor hasn't presented the last masks yet,
+ * changes are held back and sent together once it has.
+ */
+class BlurMaskAggregator : public QObject
+{
+    Q_OBJECT
+public:
+    ~BlurMaskAggregator() override;
+
+    /**
+     * The aggregator of @p window, created on first use
+     */
+    static BlurMaskAggregator *get(QWindow *window);
+
+    /**
+     * Sets the mask of @p item, stretched over @p geometry in window coordinates.
+     * @p mask has one byte per pixel, @p scale is the resolution it is composed at.
+     * A null @p mask blurs all of @p geometry, without a mask if the compositor
+     * supports it.
+     */
+    void setItem(const QObject *item, const QRectF &geometry, const QImage &mask, qreal intensity, qreal scale = 1);
+    void removeItem(const QObject *item);
+
+private:
+    explicit BlurMaskAggregator(QWindow *window);
+
+    struct Item
+    {
+        QRectF geometry;
+        QImage mask;
+        qreal intensity;
+        qreal scale;
+        /// mask at the size it covers in the composite of its cluster
+        QImage scaled;
+        /// Index of the cluster the item is composed in, -1 if it is sent as a rect
+        int cluster = -1;
+    };
+
+    /**
+     * Items sent as one mask
+     */
+    struct Cluster
+    {
+        QRect bounds;
+        qreal scale = 0;
+        QImage composite;
+        std::unique_ptr<BlurMask> mask;
+    };
+
+    void scheduleUpdate(const QRegion &damage);
+    void update();
+    void flush();
+    static QRect toComposite(const Cluster &cluster, const QRectF &rect);
+    bool isRect(const Item &item) const;
+    static void compose(Cluster &cluster, Item &item, const QRect &clip);
+
+    QWindow *const m_window;
+    QHash<const QObject *, Item> m_items;
+    /// Areas to compose again, in window coordinates
+    QRegion m_damage;
+    QTimer m_updateTimer;
+    /// An update was held back until the blur is applied
+    bool m_updateDeferred = false;
+
+    std::vector<Cluster> m_clusters;
+    /// Fully blurred items are sent as the region of the surface
+    bool m_regions = false;
+};
@@ -108,6 +108,10 @@ private:
     void printEvent(const WaylandEvent &e, bool omitNames = false, bool withResource = false);
     void printEventHandlerSignature(const WaylandEvent &e, const char *interfaceName, bool deepIndent = true);
     void printEnums(const std::vector<WaylandEnum> &enums);
+    void printResourceMapHelpers();
+    void printZeroCopyEventSender(const WaylandEvent &e, const char *interfaceName);
+    void printRequestDispatch(const WaylandEvent &e, const char *interfaceName, const char *interfaceNameStripped, const char *indent, bool crtp);
+    void printCrtpDispatcher(const WaylandInterface &interface, const char *interfaceName, const char *interfaceNameStripped);
 
     QByteArray stripInterfaceName(const QByteArray &name);
     bool ignoreInterface(const QByteArray &name);
@@ -125,6 +129,9 @@ private:
     QByteArray m_headerPath;
     QByteArray m_prefix;
     QList <QByteArray> m_includes;
+    bool m_intrusiveResourceMap = false;
+    bool m_zeroCopyArguments = false;
+    bool m_crtpDispatch = false;
     QXmlStreamReader *m_xml = nullptr;
 };
 
@@ -151,16 +158,25 @@ bool Scanner::parseArguments(int argc, char **argv)
         // --header-path=<path> (14 characters)
         // --prefix=<prefix> (9 characters)
         // --add-include=<include> (14 characters)
+        // --intrusive-resource-map
+        // --zero-copy-arguments
+        // --crtp-dispatch
         for (int pos = 3; pos < argc; pos++) {
             const QByteArray &option = args[pos];
             if (option.startsWith("--header-path=")) {
                 m_headerPath = option.mid(14);
             } else if (option.startsWith("--prefix=")) {
-                m_prefix = option.mid(10);
+                m_prefix = option.mid(9);
             } else if (option.startsWith("--add-include=")) {
                 auto include = option.mid(14);
                 if (!include.isEmpty())
                     m_includes << include;
+            } else if (option == "--intrusive-resource-map") {
+                m_intrusiveResourceMap = true;
+            } else if (option == "--zero-copy-arguments") {
+                m_zeroCopyArguments = true;
+            } else if (option == "--crtp-dispatch") {
+                m_crtpDispatch = true;
             } else {
                 return false;
             }
@@ -172,7 +188,7 @@ bool Scanner::parseArguments(int argc, char **argv)
 
 void Scanner::printUsage()
 {
-    fprintf(stderr, "Usage: %s [client-header|server-header|client-code|server-code] specfile [--header-path=<path>] [--prefix=<prefix>] [--add-include=<include>]\n", m_scannerName.constData());
+    fprintf(stderr, "Usage: %s [client-header|server-header|client-code|server-code] specfile [--header-path=<path>] [--prefix=<prefix>] [--add-include=<include>] [--intrusive-resource-map] [--zero-copy-arguments] [--crtp-dispatch]\n", m_scannerName.constData());
 }
 
 bool Scanner::isServerSide()
@@ -313,6 +329,15 @@ QByteArray Scanner::waylandToCType(const QByteArray &waylandType, const QByteArr
 
 QByteArray Scanner::waylandToQtType(const QByteArray &waylandType, const QByteArray &interface, bool cStyleArray)
 {
+    if (m_zeroCopyArguments && isServerSide()) {
+        // Views of the libwayland buffers, requests are the cStyleArray case on the server.
+        // Events take C strings, libwayland needs them null terminated.
+        if (waylandType == "string")
+            return cStyleArray ? "std::string_view" : "const char *";
+        if (waylandType == "array")
+            return "std::span<const std::byte>";
+    }
+
     if (waylandType == "string")
         return "const QString &";
     else if (waylandType == "array")
@@ -411,6 +436,326 @@ void Scanner::printEnums(const std::vector<WaylandEnum> &enums)
     }
 }
 
+void Scanner::printResourceMapHelpers()
+{
+    // Shared by all the headers generated with --intrusive-resource-map
+    printf("\n");
+    printf("#ifndef QT_WAYLAND_SERVER_RESOURCE_MAP\n");
+    printf("#define QT_WAYLAND_SERVER_RESOURCE_MAP\n");
+    printf("    // The resources of an interface, chained per client behind a hash of the most\n");
+    printf("    // recent resource of every client. Insertion and removal are O(1) and looking at\n");
+    printf("    // the resources copies nothing, so resources must not be destroyed while iterating.\n");
+    printf("    //\n");
+    printf("    // resourceMap() returns a reference to it instead of a QMultiMap copy. It offers the\n");
+    printf("    // read-only QMultiMap API, values() and keys() still return lists in the same order\n");
+    printf("    // for a client, but clients are iterated in hash order rather than sorted. Code that\n");
+    printf("    // modifies the map or keeps it across destruction of resources takes toMultiMap().\n");
+    printf("    template<typename Resource>\n");
+    printf("    class ResourceMap\n");
+    printf("    {\n");
+    printf("    public:\n");
+    printf("        class ClientRange\n");
+    printf("        {\n");
+    printf("        public:\n");
+    printf("            class const_iterator\n");
+    printf("            {\n");
+    printf("            public:\n");
+    printf("                using iterator_category = std::forward_iterator_tag;\n");
+    printf("                using value_type = Resource *;\n");
+    printf("                using difference_type = std::ptrdiff_t;\n");
+    printf("                using pointer = Resource *const *;\n");
+    printf("                using reference = Resource *;\n");
+    printf("                explicit const_iterator(Resource *resource) : m_resource(resource) {}\n");
+    printf("                Resource *operator*() const { return m_resource; }\n");
+    printf("                const_iterator &operator++() { m_resource = m_resource->next_resource; return *this; }\n");
+    printf("                const_iterator operator++(int) { const_iterator it = *this; ++*this; return it; }\n");
+    printf("                bool operator==(const const_iterator &other) const { return m_resource == other.m_resource; }\n");
+    printf("                bool operator!=(const const_iterator &other) const { return m_resource != other.m_resource; }\n");
+    printf("            private:\n");
+    printf("                Resource *m_resource;\n");
+    printf("            };\n");
+    printf("\n");
+    printf("            explicit ClientRange(Resource *first) : m_first(first) {}\n");
+    printf("            const_iterator begin() const { return const_iterator(m_first); }\n");
+    printf("            const_iterator end() const { return const_iterator(nullptr); }\n");
+    printf("            bool isEmpty() const { return !m_first; }\n");
+    printf("        private:\n");
+    printf("            Resource *m_first;\n");
+    printf("        };\n");
+    printf("\n");
+    printf("        class const_iterator\n");
+    printf("        {\n");
+    printf("        public:\n");
+    printf("            using iterator_category = std::forward_iterator_tag;\n");
+    printf("            using value_type = Resource *;\n");
+    printf("            using difference_type = std::ptrdiff_t;\n");
+    printf("            using pointer = Resource *const *;\n");
+    printf("            using reference = Resource *;\n");
+    printf("            using HashIterator = typename QHash<struct ::wl_client *, Resource *>::const_iterator;\n");
+    printf("            const_iterator(HashIterator it, HashIterator end) : m_it(it), m_end(end), m_resource(it != end ? *it : nullptr) {}\n");
+    printf("            Resource *operator*() const { return m_resource; }\n");
+    printf("            const_iterator &operator++()\n");
+    printf("            {\n");
+    printf("                m_resource = m_resource->next_resource;\n");
+    printf("                if (!m_resource && ++m_it != m_end)\n");
+    printf("                    m_resource = *m_it;\n");
+    printf("                return *this;\n");
+    printf("            }\n");
+    printf("            const_iterator operator++(int) { const_iterator it = *this; ++*this; return it; }\n");
+    printf("            bool operator==(const const_iterator &other) const { return m_resource == other.m_resource; }\n");
+    printf("            bool operator!=(const const_iterator &other) const { return m_resource != other.m_resource; }\n");
+    printf("        private:\n");
+    printf("            HashIterator m_it;\n");
+    printf("            HashIterator m_end;\n");
+    printf("            Resource *m_resource;\n");
+    printf("        };\n");
+    printf("\n");
+    printf("        void insert(struct ::wl_client *client, Resource *resource)\n");
+    printf("        {\n");
+    printf("            Resource *&head = m_heads[client];\n");
+    printf("            resource->prev_resource = nullptr;\n");
+    printf("            resource->next_resource = head;\n");
+    printf("            if (head)\n");
+    printf("                head->prev_resource = resource;\n");
+    printf("            head = resource;\n");
+    printf("            ++m_size;\n");
+    printf("        }\n");
+    printf("\n");
+    printf("        void remove(struct ::wl_client *client, Resource *resource)\n");
+    printf("        {\n");
+    printf("            if (resource->prev_resource) {\n");
+    printf("                resource->prev_resource->next_resource = resource->next_resource;\n");
+    printf("            } else {\n");
+    printf("                // Resources that were never inserted are not at the head either\n");
+    printf("                auto it = m_heads.find(client);\n");
+    printf("                if (it == m_heads.end() || *it != resource)\n");
+    printf("                    return;\n");
+    printf("                if (resource->next_resource)\n");
+    printf("                    *it = resource->next_resource;\n");
+    printf("                else\n");
+    printf("                    m_heads.erase(it);\n");
+    printf("            }\n");
+    printf("            if (resource->next_resource)\n");
+    printf("                resource->next_resource->prev_resource = resource->prev_resource;\n");
+    printf("            resource->prev_resource = nullptr;\n");
+    printf("            resource->next_resource = nullptr;\n");
+    printf("            --m_size;\n");
+    printf("        }\n");
+    printf("\n");
+    printf("        // The resources of client without copying, newest first\n");
+    printf("        ClientRange resources(struct ::wl_client *client) const { return ClientRange(m_heads.value(client)); }\n");
+    printf("\n");
+    printf("        Resource *value(struct ::wl_client *client) const { return m_heads.value(client); }\n");
+    printf("        QList<Resource *> values() const { return QList<Resource *>(begin(), end()); }\n");
+    printf("        QList<Resource *> values(struct ::wl_client *client) const\n");
+    printf("        {\n");
+    printf("            const ClientRange range = resources(client);\n");
+    printf("            return QList<Resource *>(range.begin(), range.end());\n");
+    printf("        }\n");
+    printf("        QList<struct ::wl_client *> keys() const\n");
+    printf("        {\n");
+    printf("            QList<struct ::wl_client *> keys;\n");
+    printf("            keys.reserve(m_size);\n");
+    printf("            for (auto it = m_heads.cbegin(); it != m_heads.cend(); ++it)\n");
+    printf("                keys.insert(keys.size(), count(it.key()), it.key());\n");
+    printf("            return keys;\n");
+    printf("        }\n");
+    printf("        QList<struct ::wl_client *> uniqueKeys() const { return m_heads.keys(); }\n");
+    printf("        bool contains(struct ::wl_client *client) const { return m_heads.contains(client); }\n");
+    printf("        qsizetype size() const { return m_size; }\n");
+    printf("        qsizetype count() const { return m_size; }\n");
+    printf("        qsizetype count(struct ::wl_client *client) const\n");
+    printf("        {\n");
+    printf("            const ClientRange range = resources(client);\n");
+    printf("            return std::distance(range.begin(), range.end());\n");
+    printf("        }\n");
+    printf("        bool isEmpty() const { return m_size == 0; }\n");
+    printf("        QMultiMap<struct ::wl_client *, Resource *> toMultiMap() const\n");
+    printf("        {\n");
+    printf("            QMultiMap<struct ::wl_client *, Resource *> map;\n");
+    printf("            // Oldest first, QMultiMap returns the most recently inserted value first\n");
+    printf("            for (auto it = m_heads.cbegin(); it != m_heads.cend(); ++it) {\n");
+    printf("                const QList<Resource *> resources = values(it.key());\n");
+    printf("                for (auto resource = resources.crbegin(); resource != resources.crend(); ++resource)\n");
+    printf("                    map.insert(it.key(), *resource);\n");
+    printf("            }\n");
+    printf("            return map;\n");
+    printf("        }\n");
+    printf("\n");
+    printf("        const_iterator begin() const { return const_iterator(m_heads.cbegin(), m_heads.cend()); }\n");
+    printf("        const_iterator end() const { return const_iterator(m_heads.cend(), m_heads.cend()); }\n");
+    printf("        const_iterator constBegin() const { return begin(); }\n");
+    printf("        const_iterator constEnd() const { return end(); }\n");
+    printf("\n");
+    printf("    private:\n");
+    printf("        QHash<struct ::wl_client *, Resource *> m_heads;\n");
+    printf("        qsizetype m_size = 0;\n");
+    printf("    };\n");
+    printf("\n");
+    printf("    // Keeps freed Resource objects of an interface for the next ones, objects of\n");
+    printf("    // other sizes, e.g. of subclasses, use the global allocator.\n");
+    printf("    template<typename Resource>\n");
+    printf("    class ResourcePool\n");
+    printf("    {\n");
+    printf("    public:\n");
+    printf("        static void *allocate(std::size_t size)\n");
+    printf("        {\n");
+    printf("            if (size == sizeof(Resource) && s_free) {\n");
+    printf("                Node *node = s_free;\n");
+    printf("                s_free = node->next;\n");
+    printf("                --s_count;\n");
+    printf("                return node;\n");
+    printf("            }\n");
+    printf("            return ::operator new(size);\n");
+    printf("        }\n");
+    printf("\n");
+    printf("        static void release(void *ptr, std::size_t size)\n");
+    printf("        {\n");
+    printf("            if (size == sizeof(Resource) && s_count < s_maxFree) {\n");
+    printf("                Node *node = static_cast<Node *>(ptr);\n");
+    printf("                node->next = s_free;\n");
+    printf("                s_free = node;\n");
+    printf("                ++s_count;\n");
+    printf("                return;\n");
+    printf("            }\n");
+    printf("            ::operator delete(ptr);\n");
+    printf("        }\n");
+    printf("\n");
+    printf("    private:\n");
+    printf("        struct Node\n");
+    printf("        {\n");
+    printf("            Node *next;\n");
+    printf("        };\n");
+    printf("        static constexpr int s_maxFree = 64;\n");
+    printf("        static inline Node *s_free = nullptr;\n");
+    printf("        static inline int s_count = 0;\n");
+    printf("    };\n");
+    printf("#endif\n");
+}
+
+void Scanner::printRequestDispatch(const WaylandEvent &e, const char *interfaceName, const char *interfaceNameStripped, const char *indent, bool crtp)
+{
+    printf("%s    Q_UNUSED(client);\n", indent);
+    if (crtp) {
+        // Only resources bound with the table of the dispatcher end up here
+        printf("%s    Resource *r = static_cast<Resource *>(wl_resource_get_user_data(resource));\n", indent);
+    } else {
+        printf("%s    Resource *r = Resource::fromResource(resource);\n", indent);
+    }
+    printf("%s    if (Q_UNLIKELY(!r->%s_object)) {\n", indent, interfaceNameStripped);
+    for (const WaylandArgument &a : e.arguments) {
+        if (a.type == QByteArrayLiteral("fd"))
+            printf("%s    close(%s);\n", indent, a.name.constData());
+    }
+    if (e.type == "destructor")
+        printf("%s        wl_resource_destroy(resource);\n", indent);
+    printf("%s        return;\n", indent);
+    printf("%s    }\n", indent);
+    if (crtp) {
+        // Qualified, the handler is called directly and can be inlined
+        printf("%s    static_cast<Impl *>(r->%s_object)->Impl::%s_%s(\n", indent, interfaceNameStripped, interfaceNameStripped, e.name.constData());
+    } else {
+        printf("%s    static_cast<%s *>(r->%s_object)->%s_%s(\n", indent, interfaceName, interfaceNameStripped, interfaceNameStripped, e.name.constData());
+    }
+    printf("%s        r", indent);
+    for (const WaylandArgument &a : e.arguments) {
+        printf(",\n");
+        QByteArray cType = waylandToCType(a.type, a.interface);
+        QByteArray qtType = waylandToQtType(a.type, a.interface, e.request);
+        const char *argumentName = a.name.constData();
+        if (cType == qtType)
+            printf("%s        %s", indent, argumentName);
+        else if (m_zeroCopyArguments && a.type == "string")
+            printf("%s        %s ? std::string_view(%s) : std::string_view()", indent, argumentName, argumentName);
+        else if (m_zeroCopyArguments && a.type == "array")
+            printf("%s        std::span<const std::byte>(static_cast<const std::byte *>(%s->data), %s->size)", indent, argumentName, argumentName);
+        else if (a.type == "string")
+            printf("%s        QString::fromUtf8(%s)", indent, argumentName);
+    }
+    printf(");\n");
+}
+
+void Scanner::printCrtpDispatcher(const WaylandInterface &interface, const char *interfaceName, const char *interfaceNameStripped)
+{
+    printf("\n");
+    printf("    // Calls the request handlers of Impl directly instead of through virtual methods.\n");
+    printf("    // Impl derives from it in place of %s, its handlers must be accessible\n", interfaceName);
+    printf("    // from here, i.e. public or with the dispatcher as friend.\n");
+    printf("    template<typename Impl>\n");
+    printf("    class %s_dispatch : public %s\n", interfaceName, interfaceName);
+    printf("    {\n");
+    printf("    public:\n");
+    printf("        %s_dispatch() { setImplementation(&s_dispatch_interface); }\n", interfaceName);
+    printf("        %s_dispatch(struct ::wl_client *client, int id, int version) : %s_dispatch() { init(client, id, version); }\n", interfaceName, interfaceName);
+    printf("        %s_dispatch(struct ::wl_display *display, int version) : %s_dispatch() { init(display, version); }\n", interfaceName, interfaceName);
+    printf("        explicit %s_dispatch(struct ::wl_resource *resource) : %s_dispatch() { init(resource); }\n", interfaceName, interfaceName);
+    printf("\n");
+    printf("    private:\n");
+    for (const WaylandEvent &e : interface.requests) {
+        printf("        static void ");
+        printEventHandlerSignature(e, interfaceName, true);
+        printf("\n");
+        printf("        {\n");
+        printRequestDispatch(e, interfaceName, interfaceNameStripped, "        ", true);
+        printf("        }\n");
+        printf("\n");
+    }
+    printf("        static inline const struct ::%s_interface s_dispatch_interface = {", interfaceName);
+    bool needsComma = false;
+    for (const WaylandEvent &e : interface.requests) {
+        if (needsComma)
+            printf(",");
+        needsComma = true;
+        printf("\n");
+        printf("            handle_%s", e.name.constData());
+    }
+    printf("\n");
+    printf("        };\n");
+    printf("    };\n");
+}
+
+void Scanner::printZeroCopyEventSender(const WaylandEvent &e, const char *interfaceName)
+{
+    // Fills the arguments in place of the varargs of the generated *_send_* functions
+    for (const WaylandArgument &a : e.arguments) {
+        if (a.type != "array")
+            continue;
+        const char *variableName = a.name.constData();
+        printf("        struct wl_array %s_data;\n", variableName);
+        printf("        %s_data.size = %s.size();\n", variableName, variableName);
+        printf("        %s_data.data = const_cast<std::byte *>(%s.data());\n", variableName, variableName);
+        printf("        %s_data.alloc = 0;\n", variableName);
+        printf("\n");
+    }
+
+    const QByteArray opcode = (QByteArray(interfaceName) + '_' + e.name).toUpper();
+    if (e.arguments.empty()) {
+        printf("        wl_resource_post_event_array(resource, %s, nullptr);\n", opcode.constData());
+        return;
+    }
+
+    printf("        union wl_argument arguments[%zu];\n", e.arguments.size());
+    for (size_t i = 0; i < e.arguments.size(); ++i) {
+        const WaylandArgument &a = e.arguments[i];
+        const char *variableName = a.name.constData();
+        if (a.type == "int")
+            printf("        arguments[%zu].i = %s;\n", i, variableName);
+        else if (a.type == "uint")
+            printf("        arguments[%zu].u = %s;\n", i, variableName);
+        else if (a.type == "fixed")
+            printf("        arguments[%zu].f = %s;\n", i, variableName);
+        else if (a.type == "string")
+            printf("        arguments[%zu].s = %s;\n", i, variableName);
+        else if (a.type == "object" || a.type == "new_id")
+            printf("        arguments[%zu].o = reinterpret_cast<struct ::wl_object *>(%s);\n", i, variableName);
+        else if (a.type == "array")
+            printf("        arguments[%zu].a = &%s_data;\n", i, variableName);
+        else if (a.type == "fd")
+            printf("        arguments[%zu].h = %s;\n", i, variableName);
+    }
+    printf("        wl_resource_post_event_array(resource, %s, arguments);\n", opcode.constData());
+}
+
 QByteArray Scanner::stripInterfaceName(const QByteArray &name)
 {
     if (!m_prefix.isEmpty() && name.startsWith(m_prefix))
@@ -485,8 +830,24 @@ bool Scanner::process()
         else
             printf("#include <%s/wayland-%s-server-protocol.h>\n", m_headerPath.constData(), QByteArray(m_protocolName).replace('_', '-').constData());
         printf("#include <QByteArray>\n");
+        if (m_intrusiveResourceMap) {
+            printf("#include <QHash>\n");
+            printf("#include <QList>\n");
+        }
         printf("#include <QMultiMap>\n");
         printf("#include <QString>\n");
+        if (m_zeroCopyArguments) {
+            printf("\n");
+            printf("#include <cstddef>\n");
+            printf("#include <span>\n");
+            printf("#include <string_view>\n");
+        }
+        if (m_intrusiveResourceMap) {
+            printf("\n");
+            printf("#include <cstddef>\n");
+            printf("#include <iterator>\n");
+            printf("#include <new>\n");
+        }
 
         printf("\n");
         printf("#include <unistd.h>\n");
@@ -519,6 +880,9 @@ bool Scanner::process()
         printf("\n");
         printf("namespace QtWaylandServer {\n");
 
+        if (m_intrusiveResourceMap)
+            printResourceMapHelpers();
+
         bool needsNewLine = false;
         for (const WaylandInterface &interface : interfaces) {
 
@@ -557,6 +921,15 @@ bool Scanner::process()
             printf("            int version() const { return wl_resource_get_version(handle); }\n");
             printf("\n");
             printf("            static Resource *fromResource(struct ::wl_resource *resource);\n");
+            if (m_intrusiveResourceMap) {
+                printf("\n");
+                printf("            static void *operator new(std::size_t size) { return ResourcePool<Resource>::allocate(size); }\n");
+                printf("            static void operator delete(void *ptr, std::size_t size) { ResourcePool<Resource>::release(ptr, size); }\n");
+                printf("\n");
+                printf("            // Links of the resources of the same client in ResourceMap\n");
+                printf("            Resource *prev_resource = nullptr;\n");
+                printf("            Resource *next_resource = nullptr;\n");
+            }
             printf("        };\n");
             printf("\n");
             printf("        void init(struct ::wl_client *client, int id, int version);\n");
@@ -570,8 +943,12 @@ bool Scanner::process()
             printf("        Resource *resource() { return m_resource; }\n");
             printf("        const Resource *resource() const { return m_resource; }\n");
             printf("\n");
-            printf("        QMultiMap<struct ::wl_client*, Resource*> resourceMap() { return m_resource_map; }\n");
-            printf("        const QMultiMap<struct ::wl_client*, Resource*> resourceMap() const { return m_resource_map; }\n");
+            if (m_intrusiveResourceMap) {
+                printf("        const ResourceMap<Resource> &resourceMap() const { return m_resource_map; }\n");
+            } else {
+                printf("        QMultiMap<struct ::wl_client*, Resource*> resourceMap() { return m_resource_map; }\n");
+                printf("        const QMultiMap<struct ::wl_client*, Resource*> resourceMap() const { return m_resource_map; }\n");
+            }
             printf("\n");
             printf("        bool isGlobalRemoved() const { return m_globalRemovedEvent; }\n");
             printf("        void globalRemove();\n");
@@ -609,6 +986,12 @@ bool Scanner::process()
             printf("        virtual void %s_bind_resource(Resource *resource);\n", interfaceNameStripped);
             printf("        virtual void %s_destroy_resource(Resource *resource);\n", interfaceNameStripped);
 
+            if (m_crtpDispatch) {
+                printf("\n");
+                printf("        // The request table of the resources bound from now on\n");
+                printf("        void setImplementation(const void *implementation) { m_implementation = implementation; }\n");
+            }
+
             bool hasRequests = !interface.requests.empty();
 
             if (hasRequests) {
@@ -644,7 +1027,10 @@ bool Scanner::process()
             }
 
             printf("\n");
-            printf("        QMultiMap<struct ::wl_client*, Resource*> m_resource_map;\n");
+            if (m_intrusiveResourceMap)
+                printf("        ResourceMap<Resource> m_resource_map;\n");
+            else
+                printf("        QMultiMap<struct ::wl_client*, Resource*> m_resource_map;\n");
             printf("        Resource *m_resource;\n");
             printf("        struct ::wl_global *m_global;\n");
             printf("        struct ::wl_display *m_display;\n");
@@ -653,7 +1039,12 @@ bool Scanner::process()
             printf("            %s *parent;\n", interfaceName);
             printf("        };\n");
             printf("        DisplayDestroyedListener m_displayDestroyedListener;\n");
+            if (m_crtpDispatch)
+                printf("        const void *m_implementation;\n");
             printf("    };\n");
+
+            if (m_crtpDispatch && hasRequests)
+                printCrtpDispatcher(interface, interfaceName, interfaceNameStripped);
         }
 
         printf("}\n");
@@ -706,12 +1097,16 @@ bool Scanner::process()
             printf("    }\n");
             printf("\n");
 
+            const QByteArray implementation = interface.requests.empty() ? QByteArray("nullptr") : "&m_" + interface.name + "_interface";
+
             printf("    %s::%s(struct ::wl_client *client, int id, int version)\n", interfaceName, interfaceName);
             printf("        : m_resource_map()\n");
             printf("        , m_resource(nullptr)\n");
             printf("        , m_global(nullptr)\n");
             printf("        , m_display(nullptr)\n");
             printf("        , m_globalRemovedEvent(nullptr)\n");
+            if (m_crtpDispatch)
+                printf("        , m_implementation(%s)\n", implementation.constData());
             printf("    {\n");
             printf("        init(client, id, version);\n");
             printf("    }\n");
@@ -723,6 +1118,8 @@ bool Scanner::process()
             printf("        , m_global(nullptr)\n");
             printf("        , m_display(nullptr)\n");
             printf("        , m_globalRemovedEvent(nullptr)\n");
+            if (m_crtpDispatch)
+                printf("        , m_implementation(%s)\n", implementation.constData());
             printf("    {\n");
             printf("        init(display, version);\n");
             printf("    }\n");
@@ -734,6 +1131,8 @@ bool Scanner::process()
             printf("        , m_global(nullptr)\n");
             printf("        , m_display(nullptr)\n");
             printf("        , m_globalRemovedEvent(nullptr)\n");
+            if (m_crtpDispatch)
+                printf("        , m_implementation(%s)\n", implementation.constData());
             printf("    {\n");
             printf("        init(resource);\n");
             printf("    }\n");
@@ -745,6 +1144,8 @@ bool Scanner::process()
             printf("        , m_global(nullptr)\n");
             printf("        , m_display(nullptr)\n");
             printf("        , m_globalRemovedEvent(nullptr)\n");
+            if (m_crtpDispatch)
+                printf("        , m_implementation(%s)\n", implementation.constData());
             printf("    {\n");
             printf("    }\n");
             printf("\n");
@@ -899,7 +1300,7 @@ bool Scanner::process()
             printf("        Resource *resource = %s_allocate();\n", interfaceNameStripped);
             printf("        resource->%s_object = this;\n", interfaceNameStripped);
             printf("\n");
-            printf("        wl_resource_set_implementation(handle, %s, resource, destroy_func);", interfaceMember.constData());
+            printf("        wl_resource_set_implementation(handle, %s, resource, destroy_func);", m_crtpDispatch ? "m_implementation" : interfaceMember.constData());
             printf("\n");
             printf("        resource->handle = handle;\n");
             printf("        %s_bind_resource(resource);\n", interfaceNameStripped);
@@ -910,7 +1311,15 @@ bool Scanner::process()
             printf("    {\n");
             printf("        if (Q_UNLIKELY(!resource))\n");
             printf("            return nullptr;\n");
-            printf("        if (wl_resource_instance_of(resource, &::%s_interface, %s))\n",  interfaceName, interfaceMember.constData());
+            if (m_crtpDispatch) {
+                // The request table depends on the dispatcher, so wl_resource_instance_of() can't
+                // identify the resources. Only bind() sets destroy_func, the interface is checked
+                // as well in case the linker folds identical functions of different classes.
+                printf("        if (wl_resource_get_destructor(resource) == destroy_func\n");
+                printf("            && qstrcmp(wl_resource_get_class(resource), ::%s_interface.name) == 0)\n", interfaceName);
+            } else {
+                printf("        if (wl_resource_instance_of(resource, &::%s_interface, %s))\n",  interfaceName, interfaceMember.constData());
+            }
             printf("            return static_cast<Resource *>(wl_resource_get_user_data(resource));\n");
             printf("        return nullptr;\n");
             printf("    }\n");
@@ -947,30 +1356,7 @@ bool Scanner::process()
 
                     printf("\n");
                     printf("    {\n");
-                    printf("        Q_UNUSED(client);\n");
-                    printf("        Resource *r = Resource::fromResource(resource);\n");
-                    printf("        if (Q_UNLIKELY(!r->%s_object)) {\n", interfaceNameStripped);
-                    for (const WaylandArgument &a : e.arguments) {
-                        if (a.type == QByteArrayLiteral("fd"))
-                            printf("        close(%s);\n", a.name.constData());
-                    }
-                    if (e.type == "destructor")
-                        printf("            wl_resource_destroy(resource);\n");
-                    printf("            return;\n");
-                    printf("        }\n");
-                    printf("        static_cast<%s *>(r->%s_object)->%s_%s(\n", interfaceName, interfaceNameStripped, interfaceNameStripped, e.name.constData());
-                    printf("            r");
-                    for (const WaylandArgument &a : e.arguments) {
-                        printf(",\n");
-                        QByteArray cType = waylandToCType(a.type, a.interface);
-                        QByteArray qtType = waylandToQtType(a.type, a.interface, e.request);
-                        const char *argumentName = a.name.constData();
-                        if (cType == qtType)
-                            printf("            %s", argumentName);
-                        else if (a.type == "string")
-                            printf("            QString::fromUtf8(%s)", argumentName);
-                    }
-                    printf(");\n");
+                    printRequestDispatch(e, interfaceName, interfaceNameStripped, "    ", false);
                     printf("    }\n");
                 }
             }
@@ -1001,6 +1387,13 @@ bool Scanner::process()
                 printf("\n");
                 printf("    {\n");
 
+                if (m_zeroCopyArguments) {
+                    printZeroCopyEventSender(e, interfaceName);
+                    printf("    }\n");
+                    printf("\n");
+                    continue;
+                }
+
                 for (const WaylandArgument &a : e.arguments) {
                     if (a.type != "array")
                         continue;
@@ -6,11 +6,16 @@ out vec4 fragColor;
 uniform sampler2D texUnit;
 uniform float offset;
 uniform vec2 halfpixel;
+#ifndef RECT_REGION
 uniform bool finalRound;
 uniform sampler2D alphaMask;
 uniform sampler2D original;
+#endif
+// maps the coordinates of the mask, or of the rects, to the padded background textures
+uniform vec2 backgroundScale;
+uniform vec2 backgroundOffset;
 
-vec4 sum()
+vec4 sum(vec2 uv)
 {
     vec4 sum = texture(texUnit, uv + vec2(-halfpixel.x * 2.0, 0.0) * offset);
     sum += texture(texUnit, uv + vec2(-halfpixel.x, halfpixel.y) * offset) * 2.0;
@@ -23,6 +28,13 @@ vec4 sum()
     return sum / 12.0;
 }
 
+#ifdef RECT_REGION
+// The final upsample pass of fully blurred rects, built with RECT_REGION
+void main(void)
+{
+    fragColor = sum(uv * backgroundScale + backgroundOffset);
+}
+#else
 void main(void)
 {
     if (finalRound) {
@@ -31,8 +43,10 @@ void main(void)
         if (alpha == 0.) {
             discard;
         }
-        fragColor = mix(texture(original, uv), sum(), alpha);
+        vec2 backgroundUv = uv * backgroundScale + backgroundOffset;
+        fragColor = mix(texture(original, backgroundUv), sum(backgroundUv), alpha);
     } else {
-        fragColor = sum();
+        fragColor = sum(uv);
     }
 }
+#endif
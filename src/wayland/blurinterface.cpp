@@ -14,37 +14,158 @@
 #include <opengl/glshadermanager.h>
 #include <core/graphicsbuffer.h>
 #include <core/graphicsbufferview.h>
+#include "blurmaskuploader.h"
+#include "blurmemory.h"
 #include "qwayland-server-mbition-blur-v1.h"
 #include <kwinblurng_debug.h>
 
+#include <wayland-server-protocol.h>
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstring>
+#include <utility>
+
 namespace KWin
 {
-static const quint32 s_version = 1;
+static const quint32 s_version = 5;
+
+/**
+ * Writes a mask buffer to @p decoded with one byte per pixel, returns false if
+ * @p encoded doesn't hold a mask of the size of @p decoded
+ */
+static bool decodeMask(const QImage &encoded, uint32_t encoding, QImage &decoded)
+{
+    const QSize size = decoded.size();
+    const int width = size.width();
+
+    if (encoding == QtWaylandServer::mbition_blur_mask_v1::encoding_r8) {
+        if (encoded.size() != size) {
+            return false;
+        }
+        const QImage source = encoded.format() == QImage::Format_Grayscale8 ? encoded : encoded.convertToFormat(QImage::Format_Grayscale8);
+        for (int y = 0; y < size.height(); ++y) {
+            std::memcpy(decoded.scanLine(y), source.constScanLine(y), width);
+        }
+        return true;
+    }
+
+    if (encoded.depth() != 8 || encoded.height() < size.height()) {
+        return false;
+    }
+
+    switch (encoding) {
+    case QtWaylandServer::mbition_blur_mask_v1::encoding_bitmap: {
+        const int bytesPerRow = (width + 7) / 8;
+        if (encoded.width() < bytesPerRow) {
+            return false;
+        }
+        // Every byte of the bitmap expands to eight pixels
+        static const auto expansions = [] {
+            std::array<std::array<uchar, 8>, 256> expansions;
+            for (int byte = 0; byte < 256; ++byte) {
+                for (int bit = 0; bit < 8; ++bit) {
+                    expansions[byte][bit] = (byte & (0x80 >> bit)) ? 255 : 0;
+                }
+            }
+            return expansions;
+        }();
+        for (int y = 0; y < size.height(); ++y) {
+            const uchar *in = encoded.constScanLine(y);
+            uchar *out = decoded.scanLine(y);
+            for (int x = 0; x < width; x += 8) {
+                std::memcpy(out + x, expansions[in[x / 8]].data(), std::min(8, width - x));
+            }
+        }
+        return true;
+    }
+    case QtWaylandServer::mbition_blur_mask_v1::encoding_rle:
+        for (int y = 0; y < size.height(); ++y) {
+            const uchar *in = encoded.constScanLine(y);
+            const uchar *const end = in + encoded.width() - 1;
+            uchar *out = decoded.scanLine(y);
+            int x = 0;
+            while (x < width) {
+                if (in >= end || in[0] == 0 || in[0] > width - x) {
+                    return false;
+                }
+                std::memset(out + x, in[1], in[0]);
+                x += in[0];
+                in += 2;
+            }
+        }
+        return true;
+    default:
+        return false;
+    }
+}
 
-class BlurNGMaskInterfacePrivate : public QtWaylandServer::mbition_blur_mask_v1
+// Masks get the most requests, they are dispatched without virtual calls
+class BlurNGMaskInterfacePrivate final : public QtWaylandServer::mbition_blur_mask_v1_dispatch<BlurNGMaskInterfacePrivate>
 {
 public:
-    BlurNGMaskInterfacePrivate(BlurNGMaskInterface *q, wl_resource *resource)
-        : QtWaylandServer::mbition_blur_mask_v1(resource)
+    BlurNGMaskInterfacePrivate(BlurNGMaskInterface *q, wl_resource *resource, BlurNGManagerInterface *manager)
+        : QtWaylandServer::mbition_blur_mask_v1_dispatch<BlurNGMaskInterfacePrivate>(resource)
         , q(q)
+        , m_manager(manager)
     {}
 
     void mbition_blur_mask_v1_destroy(Resource * resource) override {
+        const QRegion damage = m_appliedGeometry;
         m_geometry = {};
+        m_appliedGeometry = {};
         m_texture.reset();
-        Q_EMIT q->maskChanged();
+        m_pendingTexture.reset();
+        Q_EMIT q->maskChanged(damage);
         wl_resource_destroy(resource->handle);
     }
     void mbition_blur_mask_v1_destroy_resource(Resource * resource) override {
+        releaseAccounting();
         delete q;
     }
     void mbition_blur_mask_v1_set_mask(Resource *resource, struct ::wl_resource *mask) override
     {
-        m_buffer = Display::bufferForResource(mask);
-        if (!m_buffer.buffer()) [[unlikely]] {
+        GraphicsBufferRef buffer = Display::bufferForResource(mask);
+        if (!buffer.buffer()) [[unlikely]] {
             qCWarning(KWIN_BLUR) << "received empty mask buffer";
         }
-        m_texture.reset();
+        // What the buffer takes up once decoded
+        const QSize size = m_encoding != encoding_r8 ? m_size : buffer.buffer() ? buffer.buffer()->size() : QSize();
+        if (!reservePixels(qint64(size.width()) * size.height())) {
+            postLimitExceeded("the masks of the client have too many pixels");
+            return;
+        }
+        m_buffer = std::move(buffer);
+        m_bufferEncoding = m_encoding;
+        m_bufferSize = m_size;
+        // The current texture stays in use until the new one is uploaded
+        m_pendingTexture.reset();
+        m_bufferDirty = true;
+        m_dirty = true;
+    }
+
+    void mbition_blur_mask_v1_set_mask_encoding(Resource *resource, uint32_t encoding, uint32_t width, uint32_t height) override
+    {
+        if (encoding > encoding_rle || width == 0 || height == 0 || width > INT_MAX || height > INT_MAX) {
+            wl_resource_post_error(resource->handle, error_invalid_encoding, "invalid mask encoding %u %ux%u", encoding, width, height);
+            return;
+        }
+        m_encoding = encoding;
+        m_size = QSize(width, height);
+    }
+
+    void mbition_blur_mask_v1_set_scale(Resource *resource, uint32_t scale) override
+    {
+        if (scale == 0) {
+            wl_resource_post_error(resource->handle, error_invalid_scale, "the mask scale can't be 0");
+            return;
+        }
+        const qreal newScale = scale / 120.0;
+        if (m_scale == newScale) {
+            return;
+        }
+        m_scale = newScale;
         m_dirty = true;
     }
 
@@ -63,31 +184,127 @@ public:
         if (!m_dirty) {
             return;
         }
-        Q_EMIT q->maskChanged();
+        // Both where the mask used to be and where it is now need to be repainted
+        const QRegion damage = QRegion(m_appliedGeometry) | m_geometry;
+        m_appliedGeometry = m_geometry;
         m_dirty = false;
+        Q_EMIT q->maskChanged(damage);
     }
 
-    std::shared_ptr<GLTexture> texture() {
-        if (!m_texture) {
-            if (!m_buffer.buffer()) {
-                qCWarning(KWIN_BLUR) << "empty mask buffer";
-                return nullptr;
-            }
-            GraphicsBufferView view(m_buffer.buffer());
-            if (view.isNull()) {
-                qCWarning(KWIN_BLUR) << "empty mask";
-                return nullptr;
+    /**
+     * Starts uploading a new buffer through @p uploader, returns whether an
+     * upload is still in flight
+     */
+    bool uploadTexture(BlurNGMaskUploader *uploader)
+    {
+        if (m_bufferDirty) {
+            uploadBuffer(uploader);
+        }
+
+        if (m_pendingTexture) {
+            if (!m_pendingTexture->isReady()) {
+                return true;
             }
-            m_texture = GLTexture::upload(*view.image());
+            m_texture = m_pendingTexture->texture();
+            m_pendingTexture.reset();
+        }
+        return false;
+    }
+
+    std::shared_ptr<GLTexture> texture() {
+        if (m_bufferDirty) {
+            // Nobody staged the upload, do it synchronously
+            uploadBuffer(nullptr);
         }
         return m_texture;
     }
 
+    void uploadBuffer(BlurNGMaskUploader *uploader)
+    {
+        m_bufferDirty = false;
+        if (!m_buffer.buffer()) {
+            qCWarning(KWIN_BLUR) << "empty mask buffer";
+            m_texture.reset();
+            return;
+        }
+        GraphicsBufferView view(m_buffer.buffer());
+        if (view.isNull()) {
+            qCWarning(KWIN_BLUR) << "empty mask";
+            m_texture.reset();
+            return;
+        }
+        const QImage &image = *view.image();
+        const QSize size = m_bufferEncoding == encoding_r8 ? image.size() : m_bufferSize;
+        // Rejected before anything is allocated, mask textures take a byte per pixel
+        if (!fitsTextureLimit(qint64(size.width()) * size.height())) {
+            postLimitExceeded("the masks of the client take up too much memory");
+            m_texture.reset();
+            return;
+        }
+
+        // The shm pixels are decoded straight into the mapped pixel buffer
+        bool valid = true;
+        const auto fill = [&](QImage &target) {
+            valid = decodeMask(image, m_bufferEncoding, target);
+            return valid;
+        };
+        if (uploader) {
+            m_pendingTexture = uploader->upload(size, fill);
+        }
+        if (!m_pendingTexture && valid) {
+            QImage decoded(size, QImage::Format_Grayscale8);
+            if (fill(decoded)) {
+                m_texture = GLTexture::upload(decoded);
+            }
+        }
+        if (!valid) {
+            wl_resource_post_error(resource()->handle, error_invalid_mask, "the mask buffer doesn't match its encoding");
+            m_texture.reset();
+            return;
+        }
+        // Masks are stretched over their geometry and may have fewer pixels than it
+        GLTexture *texture = m_pendingTexture ? m_pendingTexture->texture().get() : m_texture.get();
+        if (texture) {
+            texture->setFilter(GL_LINEAR);
+            texture->setWrapMode(GL_CLAMP_TO_EDGE);
+        }
+    }
+
+    /**
+     * Accounts @p pixels to the client in place of the previous buffer, returns
+     * false if that goes beyond the limit of the client
+     */
+    bool reservePixels(qint64 pixels);
+    /**
+     * Whether a texture of @p bytes in place of the current one keeps the client
+     * within its limit
+     */
+    bool fitsTextureLimit(qint64 bytes) const;
+    void postLimitExceeded(const char *message);
+    void releaseAccounting();
+
     BlurNGMaskInterface *const q;
+    /// Tracks the usage of the client, gone if the global was removed
+    QPointer<BlurNGManagerInterface> const m_manager;
+    /// Decoded pixels of m_buffer, accounted to the client
+    qint64 m_pixels = 0;
     bool m_dirty = true;
+    /// A buffer was attached that hasn't been uploaded yet
+    bool m_bufferDirty = false;
     QRect m_geometry;
+    /// The scale of the mask buffer relative to the geometry
+    qreal m_scale = 1;
+    /// The geometry as of the last done request
+    QRect m_appliedGeometry;
+    /// The encoding of the buffers attached from now on, and the size they decode to
+    uint32_t m_encoding = encoding_r8;
+    QSize m_size;
     GraphicsBufferRef m_buffer;
+    /// The encoding of m_buffer
+    uint32_t m_bufferEncoding = encoding_r8;
+    QSize m_bufferSize;
     std::shared_ptr<GLTexture> m_texture;
+    std::unique_ptr<BlurNGPendingTexture> m_pendingTexture;
 };
 
 class BlurNGManagerInterfacePrivate : public QtWaylandServer::mbition_blur_manager_v1
@@ -105,7 +322,20 @@ public:
     void mbition_blur_manager_v1_get_blur(Resource *resource, uint32_t id, struct ::wl_resource *surface) override;
     void mbition_blur_manager_v1_get_blur_mask(Resource *resource, uint32_t id) override;
 
+    qint64 textureMemory(wl_client *client) const;
+
+    struct ClientMasks
+    {
+        QList<BlurNGMaskInterface *> masks;
+        qint64 pixels = 0;
+    };
+
+    Display *const m_display;
     QHash<SurfaceInterface *, BlurNGSurfaceInterface *> m_blurs;
+    QHash<wl_client *, ClientMasks> m_clients;
+    BlurNGClientLimits m_limits;
+    /// Protocol errors raised for clients going beyond m_limits
+    quint64 m_limitViolations = 0;
 };
 
 class BlurNGSurfaceInterfacePrivate : public QtWaylandServer::mbition_blur_surface_v1
@@ -117,6 +347,57 @@ public:
         , m_surface(s)
     {
         Q_ASSERT(m_surface);
+        wl_list_init(&m_pendingCallbacks);
+        wl_list_init(&m_callbacks);
+    }
+
+    ~BlurNGSurfaceInterfacePrivate() override
+    {
+        wl_resource *resource;
+        wl_resource *tmp;
+        wl_resource_for_each_safe (resource, tmp, &m_pendingCallbacks) {
+            wl_resource_destroy(resource);
+        }
+        wl_resource_for_each_safe (resource, tmp, &m_callbacks) {
+            wl_resource_destroy(resource);
+        }
+    }
+
+    /**
+     * Makes the callbacks requested since the last commit wait for the blur to be
+     * presented. If the commit doesn't change the blur and nothing else is being
+     * presented, they are done right away.
+     */
+    void commitCallbacks(bool blurChanged)
+    {
+        if (wl_list_empty(&m_pendingCallbacks)) {
+            return;
+        }
+        if (!blurChanged && wl_list_empty(&m_callbacks)) {
+            const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch());
+            sendCallbacks(&m_pendingCallbacks, now);
+            return;
+        }
+        wl_list_insert_list(m_callbacks.prev, &m_pendingCallbacks);
+        wl_list_init(&m_pendingCallbacks);
+    }
+
+    /**
+     * Whether m_texture is composed here rather than the texture of the only mask
+     */
+    bool ownsTexture() const
+    {
+        return m_texture && (m_masks.size() != 1 || m_texture != m_masks[0]->d->m_texture);
+    }
+
+    static void sendCallbacks(wl_list *callbacks, std::chrono::milliseconds timestamp)
+    {
+        wl_resource *resource;
+        wl_resource *tmp;
+        wl_resource_for_each_safe (resource, tmp, callbacks) {
+            wl_callback_send_done(resource, timestamp.count());
+            wl_resource_destroy(resource);
+        }
     }
 
     BlurNGSurfaceInterface *const q;
@@ -124,6 +405,16 @@ public:
     std::shared_ptr<GLTexture> m_texture;
     QVector<BlurNGMaskInterface *> m_masks;
     std::unique_ptr<GLFramebuffer> m_fbo;
+    QRegion m_pendingDamage;
+    /// The blur changes with the next commit
+    bool m_blurChangePending = false;
+    /// Blurred without a mask, the pending one applies with the next commit
+    QRegion m_region;
+    QRegion m_pendingRegion;
+    bool m_regionPending = false;
+    /// Applied callbacks of the next commit, and of the commits that are yet to be presented
+    wl_list m_pendingCallbacks;
+    wl_list m_callbacks;
 
     bool loadShmTexture(const QRegion &update)
     {
@@ -132,15 +423,30 @@ public:
             return true;
         }
 
-        if (m_masks.size() == 1) {
+        // The texture covers the whole blurred area, including the rects of m_region
+        const QRect reg = q->region().boundingRect();
+
+        if (m_masks.size() == 1 && m_masks[0]->geometry() == reg) {
             m_texture = m_masks[0]->d->texture();
             return true;
         }
 
-        const QRect reg = q->region().boundingRect();
-
-        if (!m_texture || m_texture->size() != reg.size()) {
-            m_texture = GLTexture::allocate(GL_R8, reg.size());
+        // Compose at the finest scale of the masks, reduced masks give a reduced texture
+        qreal scale = 0;
+        for (auto mask : std::as_const(m_masks)) {
+            scale = std::max(scale, mask->scale());
+        }
+        const QSize size = (QSizeF(reg.size()) * scale).toSize().expandedTo(QSize(1, 1));
+
+        // Never draw into the texture of a mask that was used as is so far
+        if (!ownsTexture() || m_texture->size() != size) {
+            m_texture = GLTexture::allocate(GL_R8, size);
+            if (!m_texture) {
+                m_fbo.reset();
+                return false;
+            }
+            m_texture->setFilter(GL_LINEAR);
+            m_texture->setWrapMode(GL_CLAMP_TO_EDGE);
             m_fbo = std::make_unique<GLFramebuffer>(m_texture.get());
         }
         m_texture->clear();
@@ -182,20 +488,106 @@ protected:
     void mbition_blur_surface_v1_destroy(Resource *resource) override;
     void mbition_blur_surface_v1_destroy_resource(Resource *resource) override;
     void mbition_blur_surface_v1_add_mask(Resource */*resource*/, struct ::wl_resource *maskResource) override {
-        m_texture.reset();
         auto mask = static_cast<BlurNGMaskInterfacePrivate *>(BlurNGMaskInterfacePrivate::Resource::fromResource(maskResource)->object())->q;
+        if (m_masks.contains(mask)) {
+            return;
+        }
+        m_texture.reset();
         QObject::connect(mask, &BlurNGMaskInterface::maskChanged, q, &BlurNGSurfaceInterface::scheduleBlurChanged);
         QObject::connect(mask, &BlurNGMaskInterface::aboutToBeDestroyed, q, [this, mask] {
             m_masks.removeAll(mask);
-            q->scheduleBlurChanged();
+            q->scheduleBlurChanged(mask->geometry());
         });
         m_masks.append(mask);
-        q->scheduleBlurChanged();
+        q->scheduleBlurChanged(mask->geometry());
+    }
+    void mbition_blur_surface_v1_set_region(Resource *resource, std::span<const std::byte> rects) override
+    {
+        if (rects.size() % (4 * sizeof(int32_t))) {
+            wl_resource_post_error(resource->handle, error_invalid_region, "the region holds a partial rect");
+            return;
+        }
+        QRegion region;
+        for (size_t i = 0; i < rects.size(); i += 4 * sizeof(int32_t)) {
+            int32_t rect[4];
+            std::memcpy(rect, rects.data() + i, sizeof(rect));
+            region += QRect(rect[0], rect[1], rect[2], rect[3]);
+        }
+        m_pendingRegion = region;
+        m_regionPending = true;
+        q->scheduleBlurChanged(QRegion());
+    }
+    void mbition_blur_surface_v1_applied(Resource *resource, uint32_t callback) override
+    {
+        wl_resource *callbackResource = wl_resource_create(resource->client(), &wl_callback_interface, 1, callback);
+        if (!callbackResource) {
+            wl_client_post_no_memory(resource->client());
+            return;
+        }
+        wl_resource_set_implementation(callbackResource, nullptr, nullptr, [](wl_resource *resource) {
+            wl_list_remove(wl_resource_get_link(resource));
+        });
+        wl_list_insert(m_pendingCallbacks.prev, wl_resource_get_link(callbackResource));
+
+        if (m_surface) {
+            QObject::connect(m_surface, &SurfaceInterface::committed, q, &BlurNGSurfaceInterface::emitBlurChanged, Qt::UniqueConnection);
+        }
     }
 };
 
-void BlurNGSurfaceInterface::scheduleBlurChanged()
+bool BlurNGMaskInterfacePrivate::reservePixels(qint64 pixels)
+{
+    if (m_manager) {
+        auto &client = m_manager->d->m_clients[resource()->client()];
+        const qint64 limit = m_manager->d->m_limits.maxPixels;
+        if (limit && client.pixels - m_pixels + pixels > limit) {
+            return false;
+        }
+        client.pixels += pixels - m_pixels;
+    }
+    m_pixels = pixels;
+    return true;
+}
+
+bool BlurNGMaskInterfacePrivate::fitsTextureLimit(qint64 bytes) const
 {
+    if (!m_manager || !m_manager->d->m_limits.maxTextureMemory) {
+        return true;
+    }
+    const qint64 usage = m_manager->d->textureMemory(resource()->client()) - textureMemoryUsage(m_texture.get());
+    return usage + bytes <= m_manager->d->m_limits.maxTextureMemory;
+}
+
+void BlurNGMaskInterfacePrivate::postLimitExceeded(const char *message)
+{
+    if (m_manager) {
+        m_manager->d->m_limitViolations++;
+    }
+    wl_resource_post_error(resource()->handle, error_limit_exceeded, "%s", message);
+}
+
+void BlurNGMaskInterfacePrivate::releaseAccounting()
+{
+    if (!m_manager) {
+        return;
+    }
+    auto &clients = m_manager->d->m_clients;
+    const auto it = clients.find(resource()->client());
+    if (it == clients.end()) {
+        return;
+    }
+    it->masks.removeOne(q);
+    it->pixels -= m_pixels;
+    if (it->masks.isEmpty()) {
+        clients.erase(it);
+    }
+}
+
+void BlurNGSurfaceInterface::scheduleBlurChanged(const QRegion &damage)
+{
+    d->m_pendingDamage += damage;
+    d->m_blurChangePending = true;
+
     // Synchronise it with the surface commit
     if (d->m_surface) {
         connect(d->m_surface, &SurfaceInterface::committed, this, &BlurNGSurfaceInterface::emitBlurChanged, Qt::UniqueConnection);
@@ -205,13 +597,50 @@ void BlurNGSurfaceInterface::scheduleBlurChanged()
 void BlurNGSurfaceInterface::emitBlurChanged()
 {
     disconnect(d->m_surface, &SurfaceInterface::committed, this, &BlurNGSurfaceInterface::emitBlurChanged);
-    Q_EMIT blurChanged(d->m_surface);
+    if (std::exchange(d->m_regionPending, false)) {
+        d->m_pendingDamage += d->m_region.xored(d->m_pendingRegion);
+        d->m_region = std::exchange(d->m_pendingRegion, QRegion());
+    }
+    const bool changed = std::exchange(d->m_blurChangePending, false);
+    d->commitCallbacks(changed);
+    if (changed) {
+        Q_EMIT blurChanged(d->m_surface, std::exchange(d->m_pendingDamage, QRegion()));
+    }
+}
+
+bool BlurNGSurfaceInterface::hasAppliedCallbacks() const
+{
+    return !wl_list_empty(&d->m_callbacks);
+}
+
+void BlurNGSurfaceInterface::sendApplied(std::chrono::milliseconds timestamp)
+{
+    BlurNGSurfaceInterfacePrivate::sendCallbacks(&d->m_callbacks, timestamp);
 }
 
 BlurNGManagerInterfacePrivate::BlurNGManagerInterfacePrivate(BlurNGManagerInterface *_q, Display *d)
     : QtWaylandServer::mbition_blur_manager_v1(*d, s_version)
     , q(_q)
+    , m_display(d)
+{
+}
+
+qint64 BlurNGManagerInterfacePrivate::textureMemory(wl_client *client) const
 {
+    qint64 usage = 0;
+    for (auto mask : m_clients.value(client).masks) {
+        usage += textureMemoryUsage(mask->d->m_texture.get());
+        if (mask->d->m_pendingTexture) {
+            usage += textureMemoryUsage(mask->d->m_pendingTexture->texture().get());
+        }
+    }
+    // Surfaces with several masks, or masks next to rects, compose them in a texture of their own
+    for (auto blur : m_blurs) {
+        if (blur->d->resource()->client() == client && blur->d->ownsTexture()) {
+            usage += textureMemoryUsage(blur->d->m_texture.get());
+        }
+    }
+    return usage;
 }
 
 void BlurNGManagerInterfacePrivate::mbition_blur_manager_v1_get_blur(Resource *resource, uint32_t id, wl_resource *surface)
@@ -233,6 +662,14 @@ void BlurNGManagerInterfacePrivate::mbition_blur_manager_v1_get_blur(Resource *r
     }
     blur = new BlurNGSurfaceInterface(blur_resource, s);
     q->connect(blur, &BlurNGSurfaceInterface::blurChanged, q, &BlurNGManagerInterface::blurChanged);
+    // The client can destroy the blur and keep the surface, it's not blurred anymore then
+    q->connect(blur, &QObject::destroyed, q, [this, s, blur = blur] {
+        if (m_blurs.value(s) != blur) {
+            return;
+        }
+        m_blurs.remove(s);
+        Q_EMIT q->blurChanged(s, QRect(QPoint(), s->size().toSize()));
+    });
     q->connect(s, &SurfaceInterface::aboutToBeDestroyed, q, [this, s] {
         m_blurs.remove(s);
     });
@@ -240,12 +677,18 @@ void BlurNGManagerInterfacePrivate::mbition_blur_manager_v1_get_blur(Resource *r
 
 void BlurNGManagerInterfacePrivate::mbition_blur_manager_v1_get_blur_mask(Resource *resource, uint32_t id)
 {
+    // Rejected clients don't get an entry, they would never release it
+    if (m_limits.maxMasks && quint32(m_clients.value(resource->client()).masks.size()) >= m_limits.maxMasks) {
+        m_limitViolations++;
+        wl_resource_post_error(resource->handle, error_too_many_masks, "the client can't have more than %u masks", m_limits.maxMasks);
+        return;
+    }
     wl_resource *newResource = wl_resource_create(resource->client(), &mbition_blur_mask_v1_interface, resource->version(), id);
     if (!newResource) {
         wl_client_post_no_memory(resource->client());
         return;
     }
-    new BlurNGMaskInterface(newResource);
+    m_clients[resource->client()].masks.append(new BlurNGMaskInterface(newResource, q));
 }
 
 BlurNGManagerInterface::BlurNGManagerInterface(Display *display, QObject *parent)
@@ -260,7 +703,37 @@ BlurNGManagerInterface::~BlurNGManagerInterface()
 
 BlurNGSurfaceInterface *BlurNGManagerInterface::surface(SurfaceInterface *surface) const
 {
-    return d->m_blurs[surface];
+    return d->m_blurs.value(surface);
+}
+
+void BlurNGManagerInterface::setClientLimits(const BlurNGClientLimits &limits)
+{
+    d->m_limits = limits;
+}
+
+BlurNGClientLimits BlurNGManagerInterface::clientLimits() const
+{
+    return d->m_limits;
+}
+
+quint64 BlurNGManagerInterface::limitViolations() const
+{
+    return d->m_limitViolations;
+}
+
+QList<BlurNGClientUsage> BlurNGManagerInterface::clientUsage() const
+{
+    QList<BlurNGClientUsage> usage;
+    usage.reserve(d->m_clients.size());
+    for (auto it = d->m_clients.cbegin(); it != d->m_clients.cend(); ++it) {
+        usage.append(BlurNGClientUsage{
+            .client = d->m_display->getConnection(it.key()),
+            .masks = quint32(it->masks.size()),
+            .pixels = it->pixels,
+            .textureMemory = d->textureMemory(it.key()),
+        });
+    }
+    return usage;
 }
 
 std::shared_ptr<GLTexture> BlurNGSurfaceInterface::mask() const
@@ -270,15 +743,42 @@ std::shared_ptr<GLTexture> BlurNGSurfaceInterface::mask() const
     return d->m_texture;
 }
 
+bool BlurNGSurfaceInterface::uploadMasks(BlurNGMaskUploader *uploader)
+{
+    bool pending = false;
+    for (auto mask : std::as_const(d->m_masks)) {
+        pending |= mask->d->uploadTexture(uploader);
+    }
+    return pending;
+}
+
 QRegion BlurNGSurfaceInterface::region() const
 {
-    QRegion region;
+    QRegion region = d->m_region;
     for (auto mask : std::as_const(d->m_masks)) {
         region |= mask->geometry();
     }
     return region;
 }
 
+QRegion BlurNGSurfaceInterface::rectRegion() const
+{
+    return d->m_region;
+}
+
+qint64 BlurNGSurfaceInterface::memoryUsage() const
+{
+    // With a single mask the surface usually shares the texture of that mask
+    qint64 usage = d->ownsTexture() ? textureMemoryUsage(d->m_texture.get()) : 0;
+    for (auto mask : std::as_const(d->m_masks)) {
+        usage += textureMemoryUsage(mask->d->m_texture.get());
+        if (mask->d->m_pendingTexture) {
+            usage += textureMemoryUsage(mask->d->m_pendingTexture->texture().get());
+        }
+    }
+    return usage;
+}
+
 void BlurNGManagerInterface::remove()
 {
     d->globalRemove();
@@ -302,9 +802,9 @@ BlurNGSurfaceInterface::BlurNGSurfaceInterface(wl_resource *resource, SurfaceInt
 
 BlurNGSurfaceInterface::~BlurNGSurfaceInterface() = default;
 
-BlurNGMaskInterface::BlurNGMaskInterface(wl_resource *resource)
+BlurNGMaskInterface::BlurNGMaskInterface(wl_resource *resource, BlurNGManagerInterface *manager)
     : QObject()
-    , d(new BlurNGMaskInterfacePrivate(this, resource))
+    , d(new BlurNGMaskInterfacePrivate(this, resource, manager))
 {
 }
 
@@ -320,7 +820,12 @@ GraphicsBufferRef BlurNGMaskInterface::buffer() const
 
 QRect BlurNGMaskInterface::geometry() const
 {
-    return d->m_geometry;
+    return d->m_appliedGeometry;
+}
+
+qreal BlurNGMaskInterface::scale() const
+{
+    return d->m_scale;
 }
 
 }
@@ -11,6 +11,8 @@
 #include "kwin_export.h"
 
 #include <QObject>
+#include <QRegion>
+#include <chrono>
 #include <memory>
 
 struct wl_resource;
@@ -21,11 +23,31 @@ class BlurNGSurfaceInterface;
 class BlurNGManagerInterfacePrivate;
 class BlurNGSurfaceInterfacePrivate;
 class BlurNGMaskInterfacePrivate;
+class BlurNGMaskUploader;
+class ClientConnection;
 class Display;
 class GLTexture;
 class GraphicsBufferRef;
 class SurfaceInterface;
 
+/**
+ * Resources a single client may take up with its masks, 0 means no limit
+ */
+struct BlurNGClientLimits
+{
+    quint32 maxMasks = 0;
+    qint64 maxPixels = 0;
+    qint64 maxTextureMemory = 0;
+};
+
+struct BlurNGClientUsage
+{
+    ClientConnection *client;
+    quint32 masks;
+    qint64 pixels;
+    qint64 textureMemory;
+};
+
 class BlurNGManagerInterface : public QObject
 {
     Q_OBJECT
@@ -36,10 +58,27 @@ public:
     BlurNGSurfaceInterface *surface(SurfaceInterface *surface) const;
     void remove();
 
+    /**
+     * Clients going beyond @p limits get a protocol error. Already exceeded limits
+     * are enforced on the next request of the client.
+     */
+    void setClientLimits(const BlurNGClientLimits &limits);
+    BlurNGClientLimits clientLimits() const;
+    QList<BlurNGClientUsage> clientUsage() const;
+    /**
+     * How many protocol errors were raised for clients going beyond the limits
+     */
+    quint64 limitViolations() const;
+
 Q_SIGNALS:
-    void blurChanged(SurfaceInterface *s);
+    /**
+     * The blur of @p s changed, @p damage is the union of the old and new blurred
+     * areas in surface local coordinates.
+     */
+    void blurChanged(SurfaceInterface *s, const QRegion &damage);
 
 private:
+    friend class BlurNGMaskInterfacePrivate;
     std::unique_ptr<BlurNGManagerInterfacePrivate> d;
 };
 
@@ -55,12 +94,39 @@ public:
     ~BlurNGSurfaceInterface() override;
 
     std::shared_ptr<GLTexture> mask() const;
+    /**
+     * Starts uploading the mask buffers that changed through @p uploader.
+     *
+     * @returns whether uploads are still in flight, mask() keeps returning the
+     * previous masks for those until they finish
+     */
+    bool uploadMasks(BlurNGMaskUploader *uploader);
+    /**
+     * The blurred area, the masks and rectRegion() together
+     */
     QRegion region() const;
-    void scheduleBlurChanged();
+    /**
+     * The part that is blurred fully, without a mask
+     */
+    QRegion rectRegion() const;
+    /**
+     * Estimated video memory used by the mask textures of this surface, in bytes
+     */
+    qint64 memoryUsage() const;
+    void scheduleBlurChanged(const QRegion &damage);
     void emitBlurChanged();
 
+    /**
+     * Whether the client waits for the committed blur to be presented
+     */
+    bool hasAppliedCallbacks() const;
+    /**
+     * Tells the client that the committed blur is presented
+     */
+    void sendApplied(std::chrono::milliseconds timestamp);
+
 Q_SIGNALS:
-    void blurChanged(SurfaceInterface *s);
+    void blurChanged(SurfaceInterface *s, const QRegion &damage);
 
 private:
     explicit BlurNGSurfaceInterface(wl_resource *resource, SurfaceInterface *s);
@@ -81,15 +147,22 @@ class BlurNGMaskInterface : public QObject
 public:
     ~BlurNGMaskInterface() override;
 
+    /**
+     * The geometry as of the last done request
+     */
     QRect geometry() const;
+    /**
+     * The scale of the mask buffer relative to geometry(), below 1 for reduced masks
+     */
+    qreal scale() const;
     GraphicsBufferRef buffer() const;
 
 Q_SIGNALS:
     void aboutToBeDestroyed();
-    void maskChanged();
+    void maskChanged(const QRegion &damage);
 
 private:
-    explicit BlurNGMaskInterface(wl_resource *resource);
+    explicit BlurNGMaskInterface(wl_resource *resource, BlurNGManagerInterface *manager);
     friend class BlurNGManagerInterface;
     friend class BlurNGManagerInterfacePrivate;
     friend class BlurNGSurfaceInterfacePrivate;